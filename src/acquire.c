@@ -0,0 +1,141 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/interrupt.h>
+
+#include "io.h"
+#include "configuration.h"
+#include "streams.h"
+#include "terminal.h"
+#include "scheduler.h"
+#include "main.h"
+#include "acquire.h"
+
+
+/* Periodic acquisition.
+A stored macro is run at a fixed period, counted in 1ms ticks of timer 1.
+The ticks only mark samples as due, the macro itself is run from the
+acquisition task. Each sample is announced with its index, so the output
+of the first command of the macro reads like "12:...".
+
+Should a sample take longer than the period, the missed samples are
+skipped, which shows as a gap in the indices. The acquisition ends after
+the given number of samples (or never for zero), with ACQUIRE alone or
+at the first failing command.
+
+The macro is looked up by name once, and again only after a definition
+has moved the macros around in the pool. Deleting it ends the
+acquisition. The index is held back until the macro replies, a sample
+without a reply prints nothing.
+*/
+
+static volatile unsigned char due;
+static volatile unsigned elapsed;
+static unsigned period;
+
+static char macro_name[CONFIGURATION_MACRO_NAME + 1];
+static unsigned macro_first;
+static unsigned char macro_changes;
+static unsigned samples;
+static unsigned long sample;
+
+
+void acquire_timer(void) {
+	if ( period && (++elapsed >= period) ) {
+		elapsed = 0;
+		if (due < 0xFF)
+			due++;
+	}
+}
+
+
+void acquire_start(const char *name, unsigned ms, unsigned n) {
+	strncpy(macro_name, name, CONFIGURATION_MACRO_NAME);
+	macro_first = configuration_macro(macro_name);
+	macro_changes = configuration_macro_changes();
+	samples = n;
+	sample = 0;
+
+	cli();
+	period = ms;
+	elapsed = 0;
+
+	/* First sample right away */
+	due = 1;
+	sei();
+}
+
+void acquire_stop(void) {
+	cli();
+	period = 0;
+	due = 0;
+	sei();
+}
+
+
+void acquire_task(void) {
+	unsigned char n;
+
+	if (scheduler_wanted())
+		/* Command line waiting, the sample is taken late */
+		return;
+
+	cli();
+	n = due;
+	due = 0;
+	sei();
+
+	if (!n)
+		return;
+
+	/* Skip missed samples */
+	sample += n - 1;
+	if ( samples && (sample >= samples) ) {
+		acquire_stop();
+		return;
+	}
+
+	if (macro_changes != configuration_macro_changes()) {
+		macro_first = configuration_macro(macro_name);
+		macro_changes = configuration_macro_changes();
+	}
+
+	if (macro_first == CONFIGURATION_MACRO_NONE) {
+		ERROR(TERMINAL_ERROR);
+		acquire_stop();
+		return;
+	}
+
+	ttyio_prefix(sample);
+	terminal_macro(macro_first);
+	ttyio_unprefix();
+	if (VOLATILE(unsigned, red_pattern) != NO_ERROR)
+		acquire_stop();
+
+	if ( samples && (++sample >= samples) )
+		acquire_stop();
+}
+
+
+void acquire_prepare(void) {
+	acquire_stop();
+}
@@ -0,0 +1,32 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef ACQUIRE_H
+#define ACQUIRE_H
+
+
+void acquire_timer(void);
+
+void acquire_start(const char *macro, unsigned period, unsigned samples);
+void acquire_stop(void);
+
+void acquire_task(void);
+void acquire_prepare(void);
+
+#endif
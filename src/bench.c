@@ -0,0 +1,110 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <stdio.h>
+
+#include <avr/interrupt.h>
+
+#include "io.h"
+#include "main.h"
+#include "gpib.h"
+#include "streams.h"
+#include "bus.h"
+#include "scheduler.h"
+#include "timebase.h"
+#include "counters.h"
+#include "bench.h"
+
+
+/* Bus throughput.
+The data is generated or discarded on the device, so the serial link is
+not involved. Timing starts as ATN is released and ends when the last
+byte has been handshaken, that is with EOI done on output and with the
+end of the message or the n-th byte on input. Stalls are the times the
+firmware found the transmit buffer full, waiting for the listeners, or
+held off a talker with the receive buffer full, respectively.
+*/
+
+static unsigned rx_stalls(void) {
+	unsigned stalls;
+
+	/* Counted in the receive interrupt */
+	cli();
+	stalls = counters.gpib_rx_stalls;
+	sei();
+	return stalls;
+}
+
+
+void bench_transmit(unsigned address, unsigned n, struct bench_t *b) {
+	unsigned stalls = counters.gpib_tx_stalls;
+	unsigned long start;
+	unsigned i;
+
+	bus_attention();
+	gpib_putchar(GPIB_UNT);
+	gpib_putchar(GPIB_UNL);
+	bus_listener(address);
+	gpib_attention(0);
+
+	b->bytes = 0;
+	start = timebase();
+	for (i = 1; i <= n; i++) {
+		/* Printable pattern */
+		char c = '0' + i % 10;
+		if (i < n)
+			gpib_putchar(c);
+		else
+			gpib_putlastchar(c);
+
+		if (VOLATILE(unsigned, red_pattern) != NO_ERROR)
+			break;
+
+		b->bytes++;
+	}
+
+	while (!gpib_transmitted())
+		scheduler_yield();
+
+	b->time = timebase() - start;
+	b->stalls = counters.gpib_tx_stalls - stalls;
+}
+
+void bench_receive(unsigned address, unsigned n, struct bench_t *b) {
+	unsigned stalls;
+	unsigned long start;
+
+	bus_talker(address);
+	clearerr(gpib);
+	gpib_receive();
+
+	b->bytes = 0;
+	stalls = rx_stalls();
+	start = timebase();
+	gpib_attention(0);
+	while ( (b->bytes < n) && (getc(gpib) != EOF) )
+		b->bytes++;
+
+	b->time = timebase() - start;
+	b->stalls = rx_stalls() - stalls;
+
+	/* Stop a talker that has more to send than counted */
+	bus_attention();
+	gpib_putchar(GPIB_UNT);
+}
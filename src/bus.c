@@ -0,0 +1,147 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <stdio.h>
+
+#include "gpib.h"
+#include "streams.h"
+#include "bus.h"
+
+
+/* Controller sequences.
+These address devices on behalf of the terminal and of the background
+tasks. Commands are sent through the raw gpib_putchar() interface after
+pending stream data has been flushed and ATN has been asserted. */
+
+/* Timeouts.
+The default timeouts apply to commands and to transfers with devices
+that have no timeouts of their own. Addressing a device listed with own
+timeouts switches to them until ATN is asserted again; with several
+listeners, the device addressed last takes effect. */
+
+struct timeouts_t {
+	unsigned address;
+	unsigned byte;
+	unsigned message;
+};
+
+static struct timeouts_t defaults;
+static struct timeouts_t devices[BUS_TIMEOUTS];
+static unsigned char ndevices;
+
+
+static void device_timeouts(unsigned address) {
+	unsigned char i;
+	for (i = 0; i < ndevices; i++) {
+		if (devices[i].address == address) {
+			gpib_timeouts(devices[i].byte, devices[i].message);
+			break;
+		}
+	}
+}
+
+unsigned char bus_timeouts(unsigned address, unsigned byte, unsigned message) {
+	struct timeouts_t *t = &defaults;
+	if (address != BUS_DEFAULT) {
+		unsigned char i;
+		for (i = 0; i < ndevices; i++) {
+			if (devices[i].address == address)
+				break;
+		}
+
+		if (i >= BUS_TIMEOUTS)
+			return 0;
+
+		if (i == ndevices)
+			ndevices++;
+
+		t = &devices[i];
+	}
+
+	t->address = address;
+	t->byte = byte;
+	t->message = message;
+	return 1;
+}
+
+void bus_timeouts_clear(void) {
+	ndevices = 0;
+}
+
+unsigned bus_timeout_byte(void) {
+	return defaults.byte;
+}
+
+unsigned bus_timeout_message(void) {
+	return defaults.message;
+}
+
+
+void bus_attention(void) {
+	gpib_transmit();
+	fflush(gpib);
+	gpib_attention(1);
+	gpib_timeouts(defaults.byte, defaults.message);
+}
+
+void bus_talker(unsigned address) {
+	bus_attention();
+	gpib_putchar(GPIB_UNT);
+	gpib_putchar(GPIB_TAGROUP(ADDRESS_PRIMARY(address)));
+	if (ADDRESS_SECONDARY(address))
+		gpib_putchar(ADDRESS_SECONDARY(address));
+
+	device_timeouts(address);
+}
+
+void bus_listener(unsigned address) {
+	gpib_putchar(GPIB_LAGROUP(ADDRESS_PRIMARY(address)));
+	if (ADDRESS_SECONDARY(address))
+		gpib_putchar(ADDRESS_SECONDARY(address));
+
+	device_timeouts(address);
+}
+
+
+/* Serial poll.
+Reads the status byte of a single device. The caller must have enabled
+the serial poll mode with SPE beforehand and disables it with SPD once
+all devices have been polled. Returns the status byte or -1 if the device
+did not respond in time; ATN is asserted again in either case. */
+int bus_poll(unsigned address) {
+	bus_attention();
+	gpib_putchar(GPIB_TAGROUP(ADDRESS_PRIMARY(address)));
+	if (ADDRESS_SECONDARY(address))
+		gpib_putchar(ADDRESS_SECONDARY(address));
+
+	device_timeouts(address);
+	gpib_receive();
+	gpib_attention(0);
+	int status = gpib_getchar();
+	gpib_attention(1);
+
+	return (status < 0) ? -1 : (unsigned char) status;
+}
+
+
+void bus_prepare(void) {
+	ndevices = 0;
+	bus_timeouts(BUS_DEFAULT, GPIB_TIMEOUT, 0);
+	gpib_timeouts(defaults.byte, defaults.message);
+}
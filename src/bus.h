@@ -0,0 +1,46 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef BUS_H
+#define BUS_H
+
+/* Device addresses carry the primary address in their lower byte and
+the secondary address command (or zero) in their upper byte. */
+#define ADDRESS_PRIMARY(a)		((unsigned char) ((a) & 0xFF))
+#define ADDRESS_SECONDARY(a)		((unsigned char) ((a) >> 8))
+
+/* Number of devices with own timeouts */
+#define BUS_TIMEOUTS			4
+
+/* Address for the default timeouts */
+#define BUS_DEFAULT			0xFFFF
+
+unsigned char bus_timeouts(unsigned address, unsigned byte, unsigned message);
+void bus_timeouts_clear(void);
+unsigned bus_timeout_byte(void);
+unsigned bus_timeout_message(void);
+
+void bus_attention(void);
+void bus_talker(unsigned address);
+void bus_listener(unsigned address);
+int bus_poll(unsigned address);
+
+void bus_prepare(void);
+
+#endif
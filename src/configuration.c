@@ -17,8 +17,11 @@ along with this program. If not, see
 	<http://www.gnu.org/licenses/>. */
 
 
+#include <string.h>
+
 #include <avr/eeprom.h>
 
+#include "scheduler.h"
 #include "configuration.h"
 
 struct configuration_t EEMEM eemem_default_configuration = {
@@ -80,7 +83,194 @@ struct configuration_t configuration = {
 };
 
 
+/* Macro pool.
+The pool starts with a version byte. A pool of another layout version,
+e.g. with different command tokens, is wiped at start-up. Command macros
+follow back to back, each one as
+	name  record  record  ...  0
+The name is padded with NULs to CONFIGURATION_MACRO_NAME characters. A
+record is a length byte followed by the command token and the remainder
+of the command line as received, hence the length counts the token as
+well. An empty record (a zero length byte) closes the macro. The pool is
+terminated by an empty name; an erased cell (0xFF) is treated alike.
+
+A macro being defined is written to the free space behind the pool
+terminator, where it is not yet part of the pool. configuration_macro_end()
+closes it and links it in by writing its name over the terminator, the
+first character last. A failed definition therefore leaves the pool and
+a previous definition untouched. On redefinition, the old copy is only
+deleted on END, by moving its successors down together with the new one;
+until then both copies need room in the pool.
+*/
+static unsigned char EEMEM eemem_macros[CONFIGURATION_MACRO_POOL];
+#define MACRO_FIRST		1
+
+/* Recorder state */
+static char macro_name[CONFIGURATION_MACRO_NAME];
+static unsigned macro_start = CONFIGURATION_MACRO_NONE;
+static unsigned macro_head;
+static unsigned macro_record;
+
+/* Counts the definitions, which move macros around in the pool */
+static unsigned char macro_changes;
+
+
+unsigned char configuration_macro_read(unsigned offset) {
+	if (offset >= CONFIGURATION_MACRO_POOL)
+		return 0;
+	else
+		return eeprom_read_byte(&eemem_macros[offset]);
+}
+
+static unsigned char write(unsigned offset, unsigned char c) {
+	if (offset >= CONFIGURATION_MACRO_POOL)
+		return 0;
+
+	while (!eeprom_is_ready())
+		scheduler_yield();
+
+	eeprom_update_byte(&eemem_macros[offset], c);
+	return 1;
+}
+
+static unsigned char named(unsigned offset) {
+	unsigned char c = configuration_macro_read(offset);
+	return (c != 0) && (c != 0xFF);
+}
+
+static unsigned skip(unsigned offset) {
+	/* Skip name and records */
+	unsigned char length;
+	offset += CONFIGURATION_MACRO_NAME;
+	while ( (length = configuration_macro_read(offset)) )
+		offset += length + 1;
+
+	return offset + 1;
+}
+
+static unsigned find(const char *name) {
+	unsigned offset = MACRO_FIRST;
+	while (named(offset)) {
+		unsigned char i;
+		for (i = 0; i < CONFIGURATION_MACRO_NAME; i++) {
+			if (configuration_macro_read(offset + i) != (unsigned char) name[i])
+				break;
+
+			if (name[i] == '\0') {
+				i = CONFIGURATION_MACRO_NAME;
+				break;
+			}
+		}
+
+		if (i == CONFIGURATION_MACRO_NAME)
+			return offset;
+
+		offset = skip(offset);
+	}
+
+	return CONFIGURATION_MACRO_NONE;
+}
+
+static unsigned end(void) {
+	unsigned offset = MACRO_FIRST;
+	while (named(offset))
+		offset = skip(offset);
+
+	return offset;
+}
+
+
+unsigned configuration_macro(const char *name) {
+	unsigned offset = find(name);
+	if (offset == CONFIGURATION_MACRO_NONE)
+		return CONFIGURATION_MACRO_NONE;
+	else
+		return offset + CONFIGURATION_MACRO_NAME;
+}
+
+void configuration_macro_define(const char *name) {
+	strncpy(macro_name, name, CONFIGURATION_MACRO_NAME);
+	macro_start = end();
+	macro_head = macro_start + CONFIGURATION_MACRO_NAME;
+	macro_record = macro_head;
+}
+
+static unsigned char put(unsigned char c) {
+	if ( (macro_start == CONFIGURATION_MACRO_NONE) ||
+		(macro_head - macro_record > 0xFF) )
+		/* Not recording or record too long */
+		return 0;
+
+	/* Fails as the pool is exhausted */
+	return write(macro_head++, c);
+}
+
+unsigned char configuration_macro_record(unsigned char token) {
+	/* Length is filled in by commit() */
+	macro_record = macro_head;
+	return put(0) && put(token);
+}
+
+unsigned char configuration_macro_put(char c) {
+	return put(c);
+}
+
+void configuration_macro_commit(void) {
+	write(macro_record, macro_head - macro_record - 1);
+	macro_record = macro_head;
+}
+
+unsigned char configuration_macro_end(void) {
+	unsigned offset;
+	unsigned char i;
+
+	/* Empty record and the terminating name behind it */
+	if ( (macro_start == CONFIGURATION_MACRO_NONE) ||
+		(macro_head + 1 >= CONFIGURATION_MACRO_POOL) ) {
+		macro_start = CONFIGURATION_MACRO_NONE;
+		return 0;
+	}
+
+	write(macro_head, 0);
+
+	if ( (offset = find(macro_name)) != CONFIGURATION_MACRO_NONE ) {
+		/* Move successors including the new macro over the old copy */
+		unsigned from = skip(offset);
+		unsigned length = from - offset;
+		while (from <= macro_head)
+			write(offset++, configuration_macro_read(from++));
+
+		macro_start -= length;
+		macro_head -= length;
+	}
+
+	write(macro_head + 1, 0);
+	for (i = CONFIGURATION_MACRO_NAME; i-- > 0; )
+		write(macro_start + i, macro_name[i]);
+
+	macro_start = CONFIGURATION_MACRO_NONE;
+	macro_changes++;
+	return 1;
+}
+
+unsigned char configuration_macro_changes(void) {
+	return macro_changes;
+}
+
+void configuration_macro_abort(void) {
+	macro_start = CONFIGURATION_MACRO_NONE;
+}
+
+
+
+
 void configuration_prepare(void) {
+	if (eeprom_read_byte(&eemem_macros[0]) != CONFIGURATION_MACRO_VERSION) {
+		/* Empty pool */
+		eeprom_update_byte(&eemem_macros[MACRO_FIRST], 0);
+		eeprom_update_byte(&eemem_macros[0], CONFIGURATION_MACRO_VERSION);
+	}
+
 	/*eeprom_read_block(
 		&configuration,
 		&eemem_configuration,
@@ -98,10 +288,26 @@ void configuration_default(void) {
 	configuration_store();
 }
 
+
+/* The configuration is written back in the background by the EEPROM
+task, one byte per step as soon as the previous write has completed.
+The write-back works on a copy taken when storing, so commands may
+change the configuration for a moment without that being persisted.
+Storing again while a write-back is in progress restarts it. */
+static struct configuration_t stored;
+static unsigned char unstored;
+
 void configuration_store(void) {
-	eeprom_update_block(
-		&configuration,
-		&eemem_configuration,
-		sizeof(configuration)
-	);
+	stored = configuration;
+	unstored = sizeof(stored);
+}
+
+void configuration_task(void) {
+	if ( unstored && eeprom_is_ready() ) {
+		unsigned char i = sizeof(stored) - unstored--;
+		eeprom_update_byte(
+			(unsigned char *) &eemem_configuration + i,
+			((unsigned char *) &stored)[i]
+		);
+	}
 }
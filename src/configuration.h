@@ -41,8 +41,29 @@ extern struct configuration_t EEMEM eemem_configuration;
 extern struct configuration_t configuration;
 
 
+/* Macro storage */
+#define CONFIGURATION_MACRO_POOL	384
+#define CONFIGURATION_MACRO_NAME	8
+#define CONFIGURATION_MACRO_NONE	0xFFFF
+
+/* Layout of the pool, including the command token values */
+#define CONFIGURATION_MACRO_VERSION	1
+
+unsigned configuration_macro(const char *name);
+unsigned char configuration_macro_read(unsigned offset);
+
+void configuration_macro_define(const char *name);
+unsigned char configuration_macro_record(unsigned char token);
+unsigned char configuration_macro_put(char c);
+void configuration_macro_commit(void);
+unsigned char configuration_macro_end(void);
+void configuration_macro_abort(void);
+unsigned char configuration_macro_changes(void);
+
+
 void configuration_prepare(void);
 void configuration_store(void);
 void configuration_default(void);
+void configuration_task(void);
 
 #endif
@@ -0,0 +1,40 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <string.h>
+
+#include <avr/interrupt.h>
+
+#include "counters.h"
+
+struct counters_t counters;
+
+
+void counters_read(struct counters_t *c) {
+	/* Consistent snapshot */
+	cli();
+	*c = counters;
+	sei();
+}
+
+void counters_reset(void) {
+	cli();
+	memset(&counters, 0, sizeof(counters));
+	sei();
+}
@@ -0,0 +1,67 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+/* Runtime statistics.
+The counters are updated in place by the interrupt handlers and by the
+hot paths, hence they are plain global fields rather than functions. The
+high-water marks record the largest number of bytes held by each ring
+buffer. */
+struct counters_t {
+	unsigned long tty_in;
+	unsigned long tty_out;
+	unsigned long gpib_in;
+	unsigned long gpib_out;
+
+	unsigned tty_overflows;
+	unsigned tty_errors;
+	unsigned tty_throttles;
+	unsigned gpib_overflows;
+	unsigned gpib_timeouts;
+	unsigned gpib_tx_stalls;
+	unsigned gpib_rx_stalls;
+
+	unsigned char tty_rx_peak;
+	unsigned char tty_tx_peak;
+	unsigned char gpib_rx_peak;
+	unsigned char gpib_tx_peak;
+};
+
+extern struct counters_t counters;
+
+#define COUNT(c) \
+	do { counters.c++; } while (0)
+
+#define PEAK(peak, head, tail, length) \
+	do {								\
+		unsigned char _head = (head);				\
+		unsigned char _tail = (tail);				\
+		unsigned char _used = (_head >= _tail) ?		\
+			_head - _tail : _head + (length) - _tail;	\
+		if (_used > counters.peak)				\
+			counters.peak = _used;				\
+	} while (0)
+
+
+void counters_read(struct counters_t *c);
+void counters_reset(void);
+
+#endif
@@ -23,6 +23,12 @@ along with this program. If not, see
 
 #include "io.h"
 #include "main.h"
+#include "scheduler.h"
+#include "timebase.h"
+#include "counters.h"
+#include "profile.h"
+#include "handshake.h"
+#include "trace.h"
 #include "gpib.h"
 
 /* High is terminated */
@@ -85,24 +91,55 @@ See tty.c for further description on how the ring buffers are implemented.
 */
 
 
-static char tx_buffer[GPIB_BUFFER_LENGTH];
+#define GPIB_RECORDS \
+	(2 * GPIB_BUFFER_LENGTH / sizeof(struct gpib_record_t))
+
+/* The monitor takes both buffers for its records */
+static union {
+	struct {
+		char tx[GPIB_BUFFER_LENGTH];
+		char rx[GPIB_BUFFER_LENGTH];
+	} ring;
+	struct gpib_record_t records[GPIB_RECORDS];
+} buffers;
+
 static unsigned char tx_head;
 static unsigned char tx_tail;
 static char tx_end;
 
-static char rx_buffer[GPIB_BUFFER_LENGTH];
 static unsigned char rx_head;
 static unsigned char rx_tail;
 static char rx_end;
 
+/* Reception timestamps */
+static unsigned long rx_first;
+static unsigned long rx_last;
+static char rx_stamped;
+
 /* 1 is transmitting, 0 is passive, -1 is receiving */
 static signed char direction;
 
+static char monitoring;
+static unsigned lost;
+
 
-static unsigned char timeout;
+/* Timeouts.
+Each byte has to be transferred within the byte timeout, counted in 1ms
+ticks from the moment the buffer is waited for. In addition, an optional
+message deadline starts when ATN is released for a data transfer and
+ends the transfer even if a talker keeps trickling bytes. ATN disarms
+the deadline again, so commands are only subject to the byte timeout. */
+static unsigned byte_timeout;
+static unsigned message_timeout;
+
+static unsigned timeout;
 static char timed_out;
 
-/* 16ms interrupt */
+static unsigned deadline;
+static char deadline_armed;
+static char overdue;
+
+/* 1ms interrupt */
 void gpib_timer(void) {
 	if (!timed_out) {
 		if (timeout)
@@ -110,6 +147,13 @@ void gpib_timer(void) {
 		else
 			timed_out = 1;
 	}
+
+	if (deadline_armed) {
+		if (deadline)
+			deadline--;
+		else
+			overdue = 1;
+	}
 }
 
 static void arm_timeout(void) {
@@ -117,13 +161,39 @@ static void arm_timeout(void) {
 	timed_out = 1;
 
 	/* Reload timeout counter */
-	timeout = 123;
+	timeout = byte_timeout;
 	timed_out = 0;
 }
 
+static void arm_deadline(char arm) {
+	/* Prevent further modification in timer interrupt */
+	VOLATILE(char, deadline_armed) = 0;
+
+	deadline = message_timeout;
+	overdue = 0;
+	VOLATILE(char, deadline_armed) = arm && message_timeout;
+}
+
+static char late(void) {
+	return VOLATILE(char, timed_out) || VOLATILE(char, overdue);
+}
+
+void gpib_timeouts(unsigned byte, unsigned message) {
+	byte_timeout = byte;
+	message_timeout = message;
+}
+
+
+/* Buffer occupancy */
+static unsigned char used(unsigned char head, unsigned char tail) {
+	return (head >= tail) ? head - tail : head + GPIB_BUFFER_LENGTH - tail;
+}
+
 
 /* 75SN160/75SN162 interface */
 static void talk(char t) {
+	trace(trace_talk, t);
+
 	if (t) {
 		/* Talk */
 		DEASSERT(IBDAV);
@@ -168,6 +238,8 @@ static void talk(char t) {
 }
 
 static void control(char c) {
+	trace(trace_control, c);
+
 	if (c) {
 		/* Take control */
 		DEASSERT(IBATN);
@@ -222,6 +294,8 @@ static void control(char c) {
 }
 
 static void atn(char a) {
+	trace(trace_atn, a);
+
 	if (a) {
 		if (_DC && _TE)
 			DIRECTION(IBEOI) = INPUT;
@@ -250,23 +324,31 @@ static void atn(char a) {
 
 
 ISR(INT0_vect) {
+	PROFILE_ENTER();
+
 	/* NRFD */
 	if (MCUCR & _BV(ISC00)) {
 		/* Devices ready to receive data */
+		HANDSHAKE(ready);
+
 		if (tx_tail != tx_head) {
 			/* More data to transmit */
-			PORTA = ~tx_buffer[tx_tail];
+			PORTA = ~buffers.ring.tx[tx_tail];
 			if (++tx_tail >= GPIB_BUFFER_LENGTH)
 				tx_tail = 0;
 
+			COUNT(gpib_out);
+
 			if (tx_end && (tx_tail == tx_head)) {
 				ASSERT(IBEOI);
+				trace(trace_eoi_out, 0);
 				tx_end = 0;
 			}
 
 			MCUCR &= ~_BV(ISC00);
 			GIFR = _BV(INTF0);
 			ASSERT(IBDAV);
+			HANDSHAKE(valid);
 
 			STATUS(TRANSMITTING_STATUS);
 		}
@@ -283,18 +365,25 @@ ISR(INT0_vect) {
 		GICR |= _BV(INT1);
 	}
 
+	PROFILE_LEAVE(profile_int0);
+
 	sei();
 }
 
 ISR(INT1_vect) {
+	PROFILE_ENTER();
+
 	/* NDAC, data accepted */
 	GICR &= ~_BV(INT1);
+	HANDSHAKE(accepted);
 
 	MCUCR |= _BV(ISC00);
 	GIFR = _BV(INTF0);
 	GICR |= _BV(INT0);
 
 	DEASSERT(IBDAV);
+
+	PROFILE_LEAVE(profile_int1);
 }
 
 
@@ -317,13 +406,25 @@ void gpib_putchar(char c) {
 	if (head >= GPIB_BUFFER_LENGTH)
 		head = 0;
 
-	tx_buffer[tx_head] = c;
+	buffers.ring.tx[tx_head] = c;
+	if (ASSERTED(IBATN)) {
+		HANDSHAKE_COMMAND(c);
+		trace(trace_command, c);
+	}
+
+	if (head == VOLATILE(unsigned char, tx_tail))
+		/* Bus is slower */
+		COUNT(gpib_tx_stalls);
+
 	arm_timeout();
-	while (!VOLATILE(char, timed_out) &&
-		(head == VOLATILE(unsigned char, tx_tail)));
+	while (!late() &&
+		(head == VOLATILE(unsigned char, tx_tail)))
+		scheduler_yield();
 
-	if (timed_out) {
+	if (late()) {
 		ERROR(GPIB_TIMEOUT_ERROR);
+		COUNT(gpib_timeouts);
+		trace(trace_timeout, used(tx_head, tx_tail));
 		abort();
 		return;
 	}
@@ -332,6 +433,8 @@ void gpib_putchar(char c) {
 	/* Request transmission */
 	VOLATILE(unsigned char, tx_head) = head;
 	transmit();
+
+	PEAK(gpib_tx_peak, head, VOLATILE(unsigned char, tx_tail), GPIB_BUFFER_LENGTH);
 }
 
 void gpib_putlastchar(char c) {
@@ -339,13 +442,25 @@ void gpib_putlastchar(char c) {
 	if (head >= GPIB_BUFFER_LENGTH)
 		head = 0;
 
-	tx_buffer[tx_head] = c;
+	buffers.ring.tx[tx_head] = c;
+	if (ASSERTED(IBATN)) {
+		HANDSHAKE_COMMAND(c);
+		trace(trace_command, c);
+	}
+
+	if (head == VOLATILE(unsigned char, tx_tail))
+		/* Bus is slower */
+		COUNT(gpib_tx_stalls);
+
 	arm_timeout();
-	while (!VOLATILE(char, timed_out) &&
-		(head == VOLATILE(unsigned char, tx_tail)));
+	while (!late() &&
+		(head == VOLATILE(unsigned char, tx_tail)))
+		scheduler_yield();
 
-	if (timed_out) {
+	if (late()) {
 		ERROR(GPIB_TIMEOUT_ERROR);
+		COUNT(gpib_timeouts);
+		trace(trace_timeout, used(tx_head, tx_tail));
 		abort();
 		return;
 	}
@@ -356,13 +471,18 @@ void gpib_putlastchar(char c) {
 	VOLATILE(unsigned char, tx_head) = head;
 	transmit();
 
+	PEAK(gpib_tx_peak, head, VOLATILE(unsigned char, tx_tail), GPIB_BUFFER_LENGTH);
+
 	/* Must not extend buffer until EOI is done */
 	arm_timeout();
-	while (!VOLATILE(char, timed_out) &&
-		VOLATILE(unsigned char, tx_end));
+	while (!late() &&
+		VOLATILE(unsigned char, tx_end))
+		scheduler_yield();
 
-	if (timed_out) {
+	if (late()) {
 		ERROR(GPIB_TIMEOUT_ERROR);
+		COUNT(gpib_timeouts);
+		trace(trace_timeout, used(tx_head, tx_tail));
 		abort();
 	}
 }
@@ -395,7 +515,31 @@ char gpib_transmitted(void) {
 
 
 ISR(INT2_vect) {
-	if (MCUCSR & _BV(ISC2)) {
+	PROFILE_ENTER();
+
+	if (monitoring) {
+		/* Sample first, the bus is not held */
+		unsigned char data = ~PINA;
+		unsigned char flags =
+			(IS(IBATN) ? GPIB_RECORD_ATN : 0) |
+			(IS(IBEOI) ? GPIB_RECORD_EOI : 0);
+		unsigned long time = timebase_interrupt();
+
+		unsigned char head = rx_head + 1;
+		if (head >= GPIB_RECORDS)
+			head = 0;
+
+		if (head == rx_tail) {
+			lost++;
+		}
+		else {
+			buffers.records[rx_head].data = data;
+			buffers.records[rx_head].flags = flags;
+			buffers.records[rx_head].time = time;
+			rx_head = head;
+		}
+	}
+	else if (MCUCSR & _BV(ISC2)) {
 		/* DAV deasserted */
 		MCUCSR &= ~_BV(ISC2);
 		GIFR |= _BV(INTF2);
@@ -408,10 +552,12 @@ ISR(INT2_vect) {
 		if (head == rx_tail) {
 			/* Delay reception */
 			GICR &= ~_BV(INT2);
+			COUNT(gpib_rx_stalls);
 		}
 		else {
 			rx_head = head;
 			DEASSERT(IBNRFD);
+			PEAK(gpib_rx_peak, head, rx_tail, GPIB_BUFFER_LENGTH);
 		}
 	}
 	else {
@@ -419,6 +565,8 @@ ISR(INT2_vect) {
 		if (ASSERTED(IBNRFD)) {
 			/* Overflow */
 			ERROR(GPIB_OVERFLOW_ERROR);
+			COUNT(gpib_overflows);
+			trace(trace_overflow, used(rx_head, rx_tail));
 			GICR &= ~_BV(INT2);
 		}
 		else {
@@ -426,29 +574,47 @@ ISR(INT2_vect) {
 			MCUCSR |= _BV(ISC2);
 			GIFR |= _BV(INTF2);
 
-			rx_buffer[rx_head] = ~PINA;
-			if (IS(IBEOI))
+			buffers.ring.rx[rx_head] = ~PINA;
+			if (IS(IBEOI)) {
 				rx_end = 1;
+				trace(trace_eoi_in, used(rx_head, rx_tail));
+			}
+
+			HANDSHAKE(received);
+
+			COUNT(gpib_in);
+
+			rx_last = timebase_interrupt();
+			if (!rx_stamped) {
+				rx_first = rx_last;
+				rx_stamped = 1;
+			}
 
 			DEASSERT(IBNDAC);
 			STATUS(RECEIVING_STATUS);
 		}
 	}
+
+	PROFILE_LEAVE(profile_int2);
 }
 
 
+/* Returns the byte received, or -1 if none arrived in time */
 int gpib_getchar(void) {
 	arm_timeout();
-	while (!VOLATILE(char, timed_out) &&
-		!gpib_received());
+	while (!late() &&
+		!gpib_received())
+		scheduler_yield();
 
-	if (timed_out) {
+	if (late()) {
 		ERROR(GPIB_TIMEOUT_ERROR);
+		COUNT(gpib_timeouts);
+		trace(trace_timeout, used(rx_head, rx_tail));
 		return -1;
 	}
 
 	unsigned char tail = rx_tail;
-	char c = rx_buffer[tail];
+	unsigned char c = buffers.ring.rx[tail];
 	if (++tail >= GPIB_BUFFER_LENGTH)
 		tail = 0;
 
@@ -471,26 +637,70 @@ int gpib_getchar(void) {
 	return c;
 }
 
+static void receiver(void) {
+	/* Flush buffer and start receiver */
+	rx_head = 0;
+	rx_tail = 0;
+	rx_end = 0;
+	rx_stamped = 0;
+	MCUCSR &= ~_BV(ISC2);
+	GIFR |= _BV(INTF2);
+	GICR |= _BV(INT2);
+
+	DEASSERT(IBNRFD);
+
+	direction = -1;
+	STATUS(RECEIVE_STATUS);
+}
+
 void gpib_receive(void) {
 	if (direction >= 0) {
 		/* Complete transmission and shutdown */
-		while (!gpib_transmitted());
+		while (!gpib_transmitted())
+			scheduler_yield();
 		GICR &= ~(_BV(INT0) | _BV(INT1));
 		talk(0);
 
-		/* Flush buffer and start receiver */
-		rx_head = 0;
-		rx_tail = 0;
-		rx_end = 0;
-		MCUCSR &= ~_BV(ISC2);
-		GIFR |= _BV(INTF2);
-		GICR |= _BV(INT2);
+		receiver();
+	}
+}
 
-		DEASSERT(IBNRFD);
+/* Listen only.
+With no controller on the bus a talk-only device sends as soon as it
+sees a listener, so the receiver is started straight from passive. A
+full buffer holds NRFD and pauses the talker. */
+void gpib_listen(void) {
+	GICR &= ~(_BV(INT2) | _BV(INT1) | _BV(INT0));
+	talk(0);
 
-		direction = -1;
-		STATUS(RECEIVE_STATUS);
-	}
+	receiver();
+}
+
+/* Time of the first and of the latest byte received since the receiver
+was started or restamped. Once a message has ended with EOI or EOS, the
+latter is the time of its end. */
+void gpib_restamp(void) {
+	/* Bytes still waiting keep their stamp */
+	cli();
+	if (rx_tail == rx_head)
+		rx_stamped = 0;
+	sei();
+}
+
+unsigned long gpib_first(void) {
+	unsigned long t;
+	cli();
+	t = rx_first;
+	sei();
+	return t;
+}
+
+unsigned long gpib_last(void) {
+	unsigned long t;
+	cli();
+	t = rx_last;
+	sei();
+	return t;
 }
 
 char gpib_received(void) {
@@ -526,6 +736,51 @@ void gpib_passive(void) {
 	STATUS(OFFLINE_STATUS);
 }
 
+/* Bus monitor.
+Every byte going over the bus is recorded on the falling edge of DAV
+along with ATN, EOI and the timebase. The handshake lines are released
+and never driven, so the monitor does not slow the bus down; records the
+host does not take in time are counted as lost. Turning the monitor off
+leaves the interface passive. */
+void gpib_monitor(char on) {
+	gpib_passive();
+
+	rx_head = 0;
+	rx_tail = 0;
+	lost = 0;
+	monitoring = on;
+	if (on) {
+		DEASSERT(IBNRFD);
+		DEASSERT(IBNDAC);
+
+		MCUCSR &= ~_BV(ISC2);
+		GIFR |= _BV(INTF2);
+		GICR |= _BV(INT2);
+	}
+}
+
+char gpib_record(struct gpib_record_t *r) {
+	unsigned char tail = rx_tail;
+	if (tail == VOLATILE(unsigned char, rx_head))
+		return 0;
+
+	*r = buffers.records[tail];
+	if (++tail >= GPIB_RECORDS)
+		tail = 0;
+
+	VOLATILE(unsigned char, rx_tail) = tail;
+	return 1;
+}
+
+unsigned gpib_lost(void) {
+	unsigned n;
+	cli();
+	n = lost;
+	lost = 0;
+	sei();
+	return n;
+}
+
 void gpib_control(void) {
 	control(1);
 	talk(0);
@@ -537,9 +792,39 @@ void gpib_control(void) {
 void gpib_attention(char attention) {
 	if (direction == 1)
 		/* Finish transmission before altering */
-		while (!gpib_transmitted());
+		while (!gpib_transmitted())
+			scheduler_yield();
 
 	atn(attention);
+	arm_deadline(!attention);
+	if (!attention)
+		HANDSHAKE(select);
+}
+
+/* Parallel poll.
+The controller sends the identify message by asserting EOI together with
+ATN. Configured devices drive their assigned DIO line within 200ns; the
+lines are sampled after at least 2us. The data bus is released for this,
+hence any transmission is completed and the receiver shut down first. ATN
+remains asserted afterwards. */
+unsigned char gpib_ppoll(void) {
+	if (direction == 1)
+		while (!gpib_transmitted())
+			scheduler_yield();
+
+	GICR &= ~(_BV(INT2) | _BV(INT1) | _BV(INT0));
+	talk(0);
+	direction = 0;
+
+	atn(1);
+	arm_deadline(0);
+	ASSERT(IBEOI);
+	_delay_us(2);
+	unsigned char response = ~PINA;
+	DEASSERT(IBEOI);
+
+	STATUS(ONLINE_STATUS);
+	return response;
 }
 
 void gpib_remote(char remote) {
@@ -558,10 +843,17 @@ void gpib_clear(void) {
 	DEASSERT(IBIFC);
 }
 
+char gpib_srq(void) {
+	/* SRQ is an input while in control */
+	return !_DC && IS(IBSRQ);
+}
+
 
 
 
 void gpib_prepare(void) {
+	gpib_timeouts(GPIB_TIMEOUT, 0);
+
 	/* Passive until initialization */
 	control(0);
 	talk(0);
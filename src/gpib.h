@@ -23,6 +23,9 @@ along with this program. If not, see
 
 #define GPIB_BUFFER_LENGTH		64
 
+/* Default byte timeout in ms */
+#define GPIB_TIMEOUT			2000
+
 /* Commands */
 #define GPIB_UCGROUP(x)			(0x10 | ((x) & 0x0F))
 #define GPIB_LLO			GPIB_UCGROUP(0x1)
@@ -45,7 +48,25 @@ along with this program. If not, see
 #define GPIB_TAGROUP(x)			(0x40 | ((x) & 0x1F))
 #define GPIB_UNT			GPIB_TAGROUP(0x1F)
 
+#define GPIB_SAGROUP(x)			(0x60 | ((x) & 0x1F))
+#define GPIB_PPE(sense, line)		(0x60 | ((sense) ? 0x08 : 0x00) | (((line) - 1) & 0x07))
+#define GPIB_PPD			0x70
+
+/* Status byte */
+#define GPIB_RQS			0x40
+
+/* Bus monitor records */
+#define GPIB_RECORD_ATN			0x01
+#define GPIB_RECORD_EOI			0x02
+
+struct gpib_record_t {
+	unsigned char data;
+	unsigned char flags;
+	unsigned long time;
+};
+
 void gpib_timer(void);
+void gpib_timeouts(unsigned byte, unsigned message);
 
 
 void gpib_putchar(char c);
@@ -57,14 +78,23 @@ char gpib_transmitted(void);
 int gpib_getchar(void);
 void gpib_receive(void);
 char gpib_received(void);
+void gpib_restamp(void);
+unsigned long gpib_first(void);
+unsigned long gpib_last(void);
 char gpib_end(void);
 
 void gpib_remote(char remote);
 void gpib_clear(void);
+char gpib_srq(void);
 
 void gpib_passive(void);
 void gpib_control(void);
+void gpib_listen(void);
+void gpib_monitor(char on);
+char gpib_record(struct gpib_record_t *r);
+unsigned gpib_lost(void);
 void gpib_attention(char attention);
+unsigned char gpib_ppoll(void);
 
 void gpib_prepare(void);
 
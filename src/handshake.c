@@ -0,0 +1,173 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifdef PROFILE
+
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "gpib.h"
+#include "handshake.h"
+
+
+static struct handshake_listeners_t listeners[HANDSHAKE_LISTENERS];
+static unsigned char nlisteners;
+
+static struct handshake_talker_t talkers[HANDSHAKE_TALKERS];
+static unsigned char ntalkers;
+
+/* Addressing as seen from the commands */
+static unsigned long listening;
+static unsigned char talking = 0xFF;
+
+/* Accounting for the current transfer, or none */
+static struct handshake_listeners_t *listener;
+static struct handshake_talker_t *talker;
+
+/* Timer 1 count at the last handshake edge */
+static unsigned mark;
+static unsigned char marked;
+
+
+static void clear(struct latency_t *l) {
+	l->min = 0xFFFF;
+	l->max = 0;
+	l->sum = 0;
+	l->n = 0;
+}
+
+static void record(struct latency_t *l, unsigned t) {
+	if (t < l->min)
+		l->min = t;
+	if (t > l->max)
+		l->max = t;
+
+	l->sum += t;
+	l->n++;
+}
+
+
+void handshake_command(unsigned char c) {
+	if (c == GPIB_UNL)
+		listening = 0;
+	else if (c == GPIB_UNT)
+		talking = 0xFF;
+	else if ( (c & 0xE0) == GPIB_LAGROUP(0) )
+		listening |= 1UL << (c & 0x1F);
+	else if ( (c & 0xE0) == GPIB_TAGROUP(0) )
+		talking = c & 0x1F;
+}
+
+/* Called as ATN is released; looks up or allocates the table entries */
+void handshake_select(void) {
+	unsigned char i;
+
+	cli();
+	marked = 0;
+	listener = 0;
+	for (i = 0; i < nlisteners; i++) {
+		if (listeners[i].set == listening)
+			listener = &listeners[i];
+	}
+
+	if ( !listener && listening && (nlisteners < HANDSHAKE_LISTENERS) ) {
+		listener = &listeners[nlisteners++];
+		listener->set = listening;
+		clear(&listener->ndac);
+		clear(&listener->nrfd);
+	}
+
+	talker = 0;
+	for (i = 0; i < ntalkers; i++) {
+		if (talkers[i].address == talking)
+			talker = &talkers[i];
+	}
+
+	if ( !talker && (talking != 0xFF) && (ntalkers < HANDSHAKE_TALKERS) ) {
+		talker = &talkers[ntalkers++];
+		talker->address = talking;
+		clear(&talker->dav);
+	}
+	sei();
+}
+
+
+/* Interrupt side */
+void handshake_valid(void) {
+	mark = TCNT1;
+	marked = 1;
+}
+
+void handshake_accepted(void) {
+	unsigned now = TCNT1;
+	if (marked && listener)
+		record(&listener->ndac, now - mark);
+
+	mark = now;
+}
+
+void handshake_ready(void) {
+	if (marked && listener)
+		record(&listener->nrfd, TCNT1 - mark);
+
+	marked = 0;
+}
+
+void handshake_received(void) {
+	unsigned now = TCNT1;
+	if (marked && talker)
+		record(&talker->dav, now - mark);
+
+	mark = now;
+	marked = 1;
+}
+
+
+unsigned char handshake_listeners(unsigned char i, struct handshake_listeners_t *l) {
+	if (i >= nlisteners)
+		return 0;
+
+	cli();
+	*l = listeners[i];
+	sei();
+	return 1;
+}
+
+unsigned char handshake_talker(unsigned char i, struct handshake_talker_t *t) {
+	if (i >= ntalkers)
+		return 0;
+
+	cli();
+	*t = talkers[i];
+	sei();
+	return 1;
+}
+
+void handshake_reset(void) {
+	cli();
+	nlisteners = 0;
+	ntalkers = 0;
+	listener = 0;
+	talker = 0;
+	sei();
+}
+
+#endif
@@ -0,0 +1,77 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef HANDSHAKE_H
+#define HANDSHAKE_H
+
+/* Handshake latency profiling.
+Only built with PROFILE defined. While transmitting, the time from DAV
+to the release of NDAC (data accepted) and from the release of DAV to
+the release of NRFD (ready for the next byte) is measured per byte and
+accounted to the set of addressed listeners. While receiving, the time
+between two DAVs is accounted to the talker. The addresses are taken
+from the commands sent, so no caller has to take care of them. */
+
+#ifdef PROFILE
+
+/* Table sizes */
+#define HANDSHAKE_LISTENERS		4
+#define HANDSHAKE_TALKERS		4
+
+struct latency_t {
+	unsigned min;
+	unsigned max;
+	unsigned long sum;
+	unsigned n;
+};
+
+struct handshake_listeners_t {
+	unsigned long set;
+	struct latency_t ndac;
+	struct latency_t nrfd;
+};
+
+struct handshake_talker_t {
+	unsigned char address;
+	struct latency_t dav;
+};
+
+void handshake_command(unsigned char c);
+void handshake_select(void);
+
+void handshake_valid(void);
+void handshake_accepted(void);
+void handshake_ready(void);
+void handshake_received(void);
+
+unsigned char handshake_listeners(unsigned char i, struct handshake_listeners_t *l);
+unsigned char handshake_talker(unsigned char i, struct handshake_talker_t *t);
+void handshake_reset(void);
+
+#define HANDSHAKE(event)		handshake_ ## event()
+#define HANDSHAKE_COMMAND(c)		handshake_command(c)
+
+#else
+
+#define HANDSHAKE(event)		do {} while (0)
+#define HANDSHAKE_COMMAND(c)		do {} while (0)
+
+#endif
+
+#endif
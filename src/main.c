@@ -26,11 +26,21 @@ along with this program. If not, see
 #include "configuration.h"
 #include "terminal.h"
 #include "streams.h"
+#include "bus.h"
+#include "request.h"
+#include "srq.h"
+#include "acquire.h"
+#include "watch.h"
+#include "timebase.h"
+#include "profile.h"
+#include "scheduler.h"
 #include "main.h"
 
 unsigned red_pattern;
 unsigned yellow_pattern;
 
+static volatile unsigned char pattern_due;
+
 
 static INLINE(void pattern(void)) {
 	static unsigned current_red_pattern = 0;
@@ -52,18 +62,80 @@ static INLINE(void pattern(void)) {
 }
 
 ISR(TIMER0_COMP_vect) {
+	PROFILE_ENTER();
+
 	static unsigned char postscaler = 0;
 	if (postscaler++ >= 8) {
 		/* 128ms interrupt */
 		postscaler = 0;
 
-		pattern();
+		pattern_due = 1;
 	}
 
 	/* 16ms interrupt */
+	scheduler_timer();
+
+	PROFILE_LEAVE(profile_timer0);
+}
+
+ISR(TIMER1_COMPA_vect) {
+	PROFILE_ENTER();
+	PROFILE_LATENCY(OCR1A);
+
+	/* 1ms interrupt */
+	OCR1A += F_CPU / 8 / 1000;
+
 	gpib_timer();
+	srq_timer();
+	acquire_timer();
+	watch_timer();
+
+	PROFILE_LEAVE(profile_timer1);
+}
+
+ISR(TIMER1_OVF_vect) {
+	PROFILE_ENTER();
+
+	timebase_overflow();
+
+	PROFILE_LEAVE(profile_overflow);
 }
 
+
+/* Tasks */
+static void patterns(void) {
+	if (pattern_due) {
+		pattern_due = 0;
+		pattern();
+	}
+}
+
+static void input(void) {
+	if ( tty_received() && scheduler_claim() ) {
+		terminal();
+		scheduler_release();
+	}
+}
+
+/* Exclusive tasks use the bus or print to the tty and never overlap. The
+others run during any wait: TERMINAL until it claims the bus for a
+command line, SRQ sampling, EEPROM write-back and LED patterns. */
+const struct task_t PROGMEM tasks[] = {
+	{ input, 0, "TERMINAL" },
+	{ srq_sample, 0, "SRQ" },
+	{ request_poll, TASK_EXCLUSIVE, "REQUEST" },
+	{ srq_task, TASK_EXCLUSIVE, "READOUT" },
+	{ acquire_task, TASK_EXCLUSIVE, "ACQUIRE" },
+	{ watch_task, TASK_EXCLUSIVE, "WATCH" },
+	{ configuration_task, 0, "EEPROM" },
+	{ patterns, 0, "PATTERN" },
+};
+
+const unsigned char ntasks = N_VECTOR(tasks);
+
+/* The scheduler keeps one bit per task */
+typedef char tasks_fit[(N_VECTOR(tasks) <= SCHEDULER_TASKS) ? 1 : -1];
+
 int main(void) {
 	/* 16ms interrupt */
 	OCR0 = 125;
@@ -73,6 +145,14 @@ int main(void) {
 		_BV(CS00);
 	TIMSK |= _BV(OCIE0);
 
+	/* Free running at 1us timebase, 1ms interrupt on compare */
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11);
+	OCR1A = F_CPU / 8 / 1000;
+	TIMSK |=
+		_BV(OCIE1A) |
+		_BV(TOIE1);
+
 
 	YELLOW = 1;
 	RED = 0;
@@ -86,14 +166,19 @@ int main(void) {
 	DDRB &= ~_BV(6);
 
 	gpib_prepare();
+	bus_prepare();
 	configuration_prepare();
 	tty_prepare();
 
 	streams_prepare();
 	terminal_prepare();
+	srq_prepare();
+	acquire_prepare();
+	watch_prepare();
+	scheduler_prepare();
 	sei();
 
 	for (;;)
-		terminal();
+		scheduler();
 }
 
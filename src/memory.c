@@ -0,0 +1,74 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <avr/io.h>
+
+#include "memory.h"
+
+
+/* SRAM usage.
+Static data (.data and .bss) ends at _end, the stack grows down from
+__stack towards it; there is no heap. Before the C runtime sets up the
+stack, the whole area in between is painted with a canary. The part that
+still carries the canary has never been touched by the stack, including
+interrupts nesting on top of it, so it is the headroom left for larger
+buffers. Interrupt handlers writing the canary value itself by chance
+can only make the headroom look larger by a few bytes. */
+
+extern unsigned char _end;
+extern unsigned char __stack;
+
+void memory_paint(void) __attribute__ ((naked, used, section(".init1")));
+
+void memory_paint(void) {
+	/* No stack and no zero register yet */
+	__asm__ volatile(
+		"\n	ldi	r30, lo8(_end)"
+		"\n	ldi	r31, hi8(_end)"
+		"\n	ldi	r24, %[canary]"
+		"\n	ldi	r25, hi8(__stack)"
+		"\n	rjmp	2f"
+		"\n 1:"
+		"\n	st	Z+, r24"
+		"\n 2:"
+		"\n	cpi	r30, lo8(__stack)"
+		"\n	cpc	r31, r25"
+		"\n	brlo	1b"
+		"\n	breq	1b"
+		:
+		: [canary] "M" (MEMORY_CANARY)
+	);
+}
+
+
+unsigned memory_static(void) {
+	return &_end - (unsigned char *) RAMSTART;
+}
+
+unsigned memory_headroom(void) {
+	const unsigned char *p = &_end;
+	while ( (p <= &__stack) && (*p == MEMORY_CANARY) )
+		p++;
+
+	return p - &_end;
+}
+
+unsigned memory_peak(void) {
+	return (&__stack + 1) - &_end - memory_headroom();
+}
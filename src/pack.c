@@ -0,0 +1,98 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include "gpib.h"
+#include "streams.h"
+#include "pack.h"
+
+
+/* Compressed transfer.
+The message is read from the bus up to EOI, bypassing the gpib stream so
+that an EOS sequence within binary data does not end it, and forwarded
+to the tty with PackBits run length encoding.
+Each record starts with a header byte n: for n up to 127, n + 1 literal
+bytes follow; for n above 128, the single following byte is to be
+repeated 257 - n times. The header 128 ends the transfer, there is no
+EOS. A timeout ends the transfer as well. Runs of two are kept with the
+literals, which never makes data grow by more than one byte per
+PACK_LITERALS. See tools/unpack.c for the decoder on the host side.
+*/
+
+static unsigned char literals[PACK_LITERALS];
+static unsigned char nliterals;
+
+static unsigned char previous;
+static unsigned char run;
+
+
+static void flush(void) {
+	unsigned char i;
+	if (!nliterals)
+		return;
+
+	ttyio_raw(nliterals - 1);
+	for (i = 0; i < nliterals; i++)
+		ttyio_raw(literals[i]);
+
+	nliterals = 0;
+}
+
+static void emit(void) {
+	if (run > 2) {
+		flush();
+		ttyio_raw(257 - run);
+		ttyio_raw(previous);
+	}
+	else {
+		while (run--) {
+			literals[nliterals++] = previous;
+			if (nliterals >= PACK_LITERALS)
+				flush();
+		}
+	}
+
+	run = 0;
+}
+
+void pack(void) {
+	int ch;
+
+	nliterals = 0;
+	run = 0;
+
+	/* Up to EOI, whose flag is only taken once the ring is drained */
+	do {
+		if ( (ch = gpib_getchar()) < 0 )
+			/* Timeout */
+			break;
+
+		if ( run && ((unsigned char) ch == previous) && (run < 128) ) {
+			run++;
+			continue;
+		}
+
+		emit();
+		previous = ch;
+		run = 1;
+	} while ( gpib_received() || !gpib_end() );
+
+	emit();
+	flush();
+	ttyio_raw(PACK_END);
+}
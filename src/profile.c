@@ -0,0 +1,75 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifdef PROFILE
+
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "profile.h"
+
+
+static unsigned histograms[PROFILE_VECTORS][PROFILE_BUCKETS];
+
+static const char PROGMEM names[PROFILE_VECTORS][8] = {
+	"INT0",
+	"INT1",
+	"INT2",
+	"UDRE",
+	"RXC",
+	"TIMER0",
+	"TIMER1",
+	"OVF",
+	"LATENCY",
+};
+
+
+/* Called from interrupts only */
+void profile_record(unsigned char vector, unsigned duration) {
+	unsigned char bucket = 0;
+	while ( (duration > 1) && (bucket < PROFILE_BUCKETS - 1) ) {
+		duration >>= 1;
+		bucket++;
+	}
+
+	/* Saturate */
+	if (histograms[vector][bucket] != 0xFFFF)
+		histograms[vector][bucket]++;
+}
+
+
+PGM_P profile_name(unsigned char vector) {
+	return names[vector];
+}
+
+void profile_histogram(unsigned char vector, unsigned *buckets) {
+	cli();
+	memcpy(buckets, histograms[vector], sizeof(histograms[vector]));
+	sei();
+}
+
+void profile_reset(void) {
+	cli();
+	memset(histograms, 0, sizeof(histograms));
+	sei();
+}
+
+#endif
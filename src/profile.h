@@ -0,0 +1,76 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Interrupt profiling.
+Only built with PROFILE defined (make PROFILE=1). Each interrupt handler
+takes the timer 1 count on entry and on exit and records its duration
+in a log2 histogram: bucket n counts durations of 2^n to 2^(n+1) - 1us,
+the last bucket takes all longer ones. Latency cannot be told for
+external events, so it is measured with the 1ms compare interrupt as a
+probe: on entry, the timer has advanced past the compare value by the
+time the interrupt was held off by other handlers or cli(). */
+
+#ifdef PROFILE
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#define PROFILE_BUCKETS			8
+
+enum profile_vector_e {
+	profile_int0 = 0,
+	profile_int1,
+	profile_int2,
+	profile_udre,
+	profile_rxc,
+	profile_timer0,
+	profile_timer1,
+	profile_overflow,
+	profile_latency,
+
+	PROFILE_VECTORS
+};
+
+#define PROFILE_ENTER() \
+	unsigned _profile_entry = TCNT1
+
+#define PROFILE_LEAVE(vector) \
+	profile_record((vector), TCNT1 - _profile_entry)
+
+#define PROFILE_LATENCY(compare) \
+	profile_record(profile_latency, _profile_entry - (compare))
+
+void profile_record(unsigned char vector, unsigned duration);
+
+PGM_P profile_name(unsigned char vector);
+void profile_histogram(unsigned char vector, unsigned *buckets);
+void profile_reset(void);
+
+#else
+
+#define PROFILE_ENTER()
+#define PROFILE_LEAVE(vector)
+#define PROFILE_LATENCY(compare)
+
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "streams.h"
+#include "reading.h"
+
+
+/* Numeric readings.
+A reply is scanned for the first number, so headers like "DCV" in front
+of it and units behind it are skipped. The remainder of the message is
+discarded. Aggregates are accumulated with Welford's method, which keeps
+the variance accurate in single precision even for thousands of readings
+with a large offset.
+
+Optionally, readings are forwarded in binary instead of the reply text.
+Each reading then takes exactly four bytes, least significant first and
+without EOS: either an IEEE single precision float, or the reading times
+a scale factor rounded to a signed long integer. Replies without a
+number come out as NaN or as the smallest long, respectively.
+*/
+
+static unsigned char format;
+static double scale;
+
+static unsigned char numeric(int ch, PGM_P signs) {
+	return isdigit(ch) || ( (ch > 0) && strchr_P(signs, ch) );
+}
+
+unsigned char reading(FILE *stream, double *x) {
+	char s[READING_LENGTH + 1];
+	unsigned char i = 0;
+	char *end;
+	int ch;
+
+	/* Skip header */
+	do {
+		ch = getc(stream);
+	} while ( (ch != EOF) && !numeric(ch, PSTR("+-.")) );
+
+	while (numeric(ch, PSTR("+-.eE"))) {
+		if (i < READING_LENGTH)
+			s[i++] = ch;
+
+		ch = getc(stream);
+	}
+
+	s[i] = '\0';
+
+	/* Discard remainder */
+	while (ch != EOF)
+		ch = getc(stream);
+
+	*x = strtod(s, &end);
+	return end != s;
+}
+
+
+void statistics_clear(struct statistics_t *s) {
+	s->n = 0;
+	s->mean = 0;
+	s->m2 = 0;
+	s->min = INFINITY;
+	s->max = -INFINITY;
+}
+
+void statistics_add(struct statistics_t *s, double x) {
+	double delta = x - s->mean;
+
+	s->n++;
+	s->mean += delta / s->n;
+	s->m2 += delta * (x - s->mean);
+
+	if (x < s->min)
+		s->min = x;
+	if (x > s->max)
+		s->max = x;
+}
+
+double statistics_deviation(const struct statistics_t *s) {
+	if (s->n < 2)
+		return 0;
+
+	return sqrt(s->m2 / (s->n - 1));
+}
+
+
+void reading_format(unsigned char f, double s) {
+	format = f;
+	scale = s;
+}
+
+unsigned char reading_binary(void) {
+	return format != READING_ASCII;
+}
+
+static void put(unsigned long u) {
+	unsigned char i;
+	for (i = 0; i < 4; i++) {
+		ttyio_raw(u & 0xFF);
+		u >>= 8;
+	}
+}
+
+void reading_forward(FILE *stream) {
+	union {
+		float f;
+		unsigned long u;
+	} v;
+
+	double x;
+	unsigned char valid = reading(stream, &x);
+
+	if (format == READING_FLOAT) {
+		v.f = valid ? x : NAN;
+		put(v.u);
+	}
+	else {
+		x *= scale;
+		if ( !valid || (x >= 2147483648.0) || (x < -2147483648.0) )
+			put(0x80000000UL);
+		else
+			put(lround(x));
+	}
+}
@@ -0,0 +1,51 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef READING_H
+#define READING_H
+
+#include <stdio.h>
+
+/* Longest number taken from a reply */
+#define READING_LENGTH			20
+
+/* Output formats */
+#define READING_ASCII			0
+#define READING_FLOAT			1
+#define READING_INT			2
+
+struct statistics_t {
+	unsigned n;
+	double mean;
+	double m2;
+	double min;
+	double max;
+};
+
+unsigned char reading(FILE *stream, double *x);
+
+void reading_format(unsigned char format, double scale);
+unsigned char reading_binary(void);
+void reading_forward(FILE *stream);
+
+void statistics_clear(struct statistics_t *s);
+void statistics_add(struct statistics_t *s, double x);
+double statistics_deviation(const struct statistics_t *s);
+
+#endif
@@ -0,0 +1,234 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <stdio.h>
+
+#include "io.h"
+#include "main.h"
+#include "gpib.h"
+#include "configuration.h"
+#include "streams.h"
+#include "bus.h"
+#include "scheduler.h"
+#include "request.h"
+
+
+/* Background reception.
+REQUEST merely queues a device for reading. Whenever the terminal is
+idle, request_poll() addresses the oldest pending device as talker and
+moves whatever has been received into the request's buffer until EOS or
+EOI. It never waits for a byte, hence the EOS is matched here rather
+than by the gpib stream, with the match state kept in the request so it
+carries over from one poll to the next. Before the terminal executes a
+command line, request_suspend() takes the bus back by asserting ATN and
+drains what has been received so far; the device is simply addressed
+again to continue the message afterwards.
+
+Requests are served in order. Each device may have a single outstanding
+request, hence RESPONSE takes the device address as the identifier.
+Retrieving a request that is still pending reads it in the foreground,
+subject to the usual timeout. Data exceeding the buffer is dropped and
+reported as an overflow upon retrieval.
+*/
+
+enum request_state_e {
+	request_pending = 0,
+	request_complete,
+	request_failed,
+};
+
+struct request_t {
+	unsigned address;
+	unsigned char state;
+	unsigned char truncated;
+	unsigned char eos;
+	unsigned char length;
+	char buffer[REQUEST_BUFFER_LENGTH];
+};
+
+/* Oldest request first */
+static struct request_t requests[REQUEST_SLOTS];
+static unsigned char nrequests;
+
+/* Active request is addressed as talker */
+static unsigned char addressed;
+
+
+static struct request_t *find(unsigned address) {
+	unsigned char i;
+	for (i = 0; i < nrequests; i++) {
+		if ( (address == REQUEST_ANY) || (requests[i].address == address) )
+			return &requests[i];
+	}
+
+	return NULL;
+}
+
+static struct request_t *active(void) {
+	unsigned char i;
+	for (i = 0; i < nrequests; i++) {
+		if (requests[i].state == request_pending)
+			return &requests[i];
+	}
+
+	return NULL;
+}
+
+static void discard(struct request_t *r) {
+	nrequests--;
+	for (; r < &requests[nrequests]; r++)
+		*r = *(r + 1);
+}
+
+
+static void receive(struct request_t *r) {
+	if (!addressed) {
+		bus_talker(r->address);
+
+		gpib_receive();
+		gpib_attention(0);
+		addressed = 1;
+	}
+}
+
+static void store(struct request_t *r, char c) {
+	if (r->length < REQUEST_BUFFER_LENGTH)
+		r->buffer[r->length++] = c;
+	else
+		r->truncated = 1;
+}
+
+static void complete(struct request_t *r) {
+	/* Next request needs addressing */
+	r->state = request_complete;
+	addressed = 0;
+}
+
+static void take(struct request_t *r, unsigned char c) {
+	char end = gpib_end() && !gpib_received();
+
+	if ( r->eos && (c != (unsigned char) configuration.gpibeos.in[r->eos]) ) {
+		/* Partial EOS was data after all */
+		store(r, configuration.gpibeos.in[0]);
+		r->eos = 0;
+	}
+
+	if ( (r->eos < configuration.gpibeos.nin) &&
+		(c == (unsigned char) configuration.gpibeos.in[r->eos]) ) {
+		if (++r->eos >= configuration.gpibeos.nin) {
+			complete(r);
+			return;
+		}
+	}
+	else {
+		store(r, c);
+	}
+
+	if (end) {
+		if (r->eos)
+			store(r, configuration.gpibeos.in[0]);
+
+		complete(r);
+	}
+}
+
+static void drain(struct request_t *r) {
+	while ( (r->state == request_pending) && gpib_received() )
+		take(r, gpib_getchar());
+}
+
+
+void request(unsigned address) {
+	if ( find(address) || (nrequests >= REQUEST_SLOTS) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	struct request_t *r = &requests[nrequests++];
+	r->address = address;
+	r->state = request_pending;
+	r->truncated = 0;
+	r->eos = 0;
+	r->length = 0;
+}
+
+void request_response(unsigned address) {
+	struct request_t *r = find(address);
+	if (!r) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	while (r->state == request_pending) {
+		/* Read in foreground, oldest first */
+		struct request_t *a = active();
+		receive(a);
+
+		int c = gpib_getchar();
+		if (c < 0) {
+			a->state = request_failed;
+			addressed = 0;
+		}
+		else {
+			take(a, c);
+		}
+	}
+
+	if (r->state == request_complete) {
+		unsigned char i;
+		for (i = 0; i < r->length; i++)
+			putchar(r->buffer[i]);
+
+		ttyio_end();
+		if (r->truncated)
+			ERROR(GPIB_OVERFLOW_ERROR);
+	}
+	else {
+		ERROR(GPIB_TIMEOUT_ERROR);
+	}
+
+	discard(r);
+}
+
+
+void request_suspend(void) {
+	struct request_t *r = active();
+	if (!addressed)
+		return;
+
+	/* Stop talker and pick up what has arrived */
+	gpib_attention(1);
+	drain(r);
+
+	addressed = 0;
+}
+
+void request_cancel(void) {
+	nrequests = 0;
+	addressed = 0;
+}
+
+void request_poll(void) {
+	struct request_t *r = active();
+	if ( !r || scheduler_wanted() )
+		return;
+
+	receive(r);
+	drain(r);
+}
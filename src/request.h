@@ -0,0 +1,40 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef REQUEST_H
+#define REQUEST_H
+
+/* Number of outstanding requests */
+#define REQUEST_SLOTS			3
+
+/* Response buffer length */
+#define REQUEST_BUFFER_LENGTH		48
+
+/* Any device */
+#define REQUEST_ANY			0xFFFF
+
+
+void request(unsigned address);
+void request_response(unsigned address);
+
+void request_suspend(void);
+void request_cancel(void);
+void request_poll(void);
+
+#endif
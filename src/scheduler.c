@@ -0,0 +1,150 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "io.h"
+#include "scheduler.h"
+
+
+/* Cooperative scheduler.
+Tasks are plain functions that do a small step of work and return; the
+task table is defined in main.c. The main loop runs them round robin via
+scheduler().
+
+Busy waits in the drivers call scheduler_yield() instead of spinning, so
+a task that has to wait for the bus or the serial line lends the time to
+the next task in turn. A task is never entered while it is running
+already. Tasks that use the bus or print to the tty are flagged
+TASK_EXCLUSIVE and do not nest into each other. Tasks without the flag,
+such as SRQ sampling, EEPROM writes and LED patterns, run during any
+transfer.
+
+A task that is only sometimes exclusive runs without the flag and takes
+exclusive use with scheduler_claim() when it has work. If an exclusive
+task holds the bus, the claim fails and marks exclusive use as wanted;
+background tasks then hold back until the claim succeeds. The terminal
+works this way, so it notices a command line while a background task is
+busy and gets the bus right after it.
+
+Run time is sampled by the 16ms timer interrupt, which charges a tick to
+whichever task is executing at that moment. The last counter holds the
+time spent outside of any task.
+*/
+
+static unsigned char running;
+static unsigned char exclusive;
+static unsigned char wanted;
+static volatile unsigned char current;
+
+static unsigned long runtime[SCHEDULER_TASKS + 1];
+
+
+/* 16ms interrupt */
+void scheduler_timer(void) {
+	runtime[current]++;
+}
+
+
+static void run(unsigned char task) {
+	unsigned char flags = pgm_read_byte(&tasks[task].flags);
+	if (running & _BV(task))
+		return;
+
+	if ( (flags & TASK_EXCLUSIVE) && exclusive )
+		return;
+
+	void (*f)(void) = (void (*)(void)) pgm_read_word(&tasks[task].run);
+	unsigned char previous = current;
+
+	running |= _BV(task);
+	if (flags & TASK_EXCLUSIVE)
+		exclusive = 1;
+
+	current = task;
+	f();
+	current = previous;
+
+	if (flags & TASK_EXCLUSIVE)
+		exclusive = 0;
+
+	running &= ~_BV(task);
+}
+
+void scheduler(void) {
+	unsigned char task;
+	for (task = 0; task < ntasks; task++)
+		run(task);
+}
+
+void scheduler_yield(void) {
+	static unsigned char next = 0;
+	if (++next >= ntasks)
+		next = 0;
+
+	run(next);
+}
+
+
+unsigned char scheduler_claim(void) {
+	if (exclusive) {
+		wanted = 1;
+		return 0;
+	}
+
+	exclusive = 1;
+	wanted = 0;
+	return 1;
+}
+
+void scheduler_release(void) {
+	exclusive = 0;
+}
+
+unsigned char scheduler_wanted(void) {
+	return wanted;
+}
+
+
+PGM_P scheduler_name(unsigned char task) {
+	if (task < ntasks)
+		return tasks[task].name;
+	else
+		return PSTR("IDLE");
+}
+
+unsigned long scheduler_runtime(unsigned char task) {
+	cli();
+	unsigned long t = runtime[task];
+	sei();
+	return t;
+}
+
+void scheduler_prepare(void) {
+	unsigned char task;
+	for (task = 0; task <= SCHEDULER_TASKS; task++)
+		runtime[task] = 0;
+
+	running = 0;
+	exclusive = 0;
+	wanted = 0;
+	current = ntasks;
+}
@@ -0,0 +1,55 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <avr/pgmspace.h>
+
+/* Maximum number of tasks */
+#define SCHEDULER_TASKS			8
+
+/* Task flags */
+#define TASK_EXCLUSIVE			0x01
+
+struct task_t {
+	void (*run)(void);
+	unsigned char flags;
+	char name[9];
+};
+
+extern const struct task_t PROGMEM tasks[];
+extern const unsigned char ntasks;
+
+
+void scheduler_timer(void);
+
+void scheduler(void);
+void scheduler_yield(void);
+
+unsigned char scheduler_claim(void);
+void scheduler_release(void);
+unsigned char scheduler_wanted(void);
+
+PGM_P scheduler_name(unsigned char task);
+unsigned long scheduler_runtime(unsigned char task);
+
+void scheduler_prepare(void);
+
+#endif
@@ -0,0 +1,216 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <stdio.h>
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "io.h"
+#include "gpib.h"
+#include "streams.h"
+#include "bus.h"
+#include "request.h"
+#include "timebase.h"
+#include "scheduler.h"
+#include "srq.h"
+
+
+/* Service requests.
+The SRQ line is not connected to an interrupt capable pin, so it is
+sampled by the SRQ task and latched when it becomes asserted. Sampling
+neither uses the bus nor prints, so the task runs during command lines
+and transfers as well.
+
+The latch is read and cleared with the SRQ query. Optionally, each new
+assertion is announced by an unsolicited "SRQ" line. This is left to the
+exclusive READOUT task, hence never happens in the middle of the
+response to a command.
+For an accurate time of the request, SRQ is also sampled every 1ms from
+the timer interrupt, which stamps each asserting edge.
+
+Readout rules let the READOUT task service requests on its own. Upon SRQ, all
+devices with a rule are serial polled in a single session. Each device
+requesting service with a status byte matching its rule's mask (or any
+status if the mask is zero) is then read like with ENTER. The data is
+forwarded to the tty prefixed by the device address, e.g. "14:...". As
+long as SRQ stays asserted, the poll is repeated for as long as it
+services a device; a request from a device without a rule is left to
+the host.
+*/
+
+struct readout_t {
+	unsigned address;
+	unsigned char mask;
+};
+
+static struct readout_t readouts[SRQ_READOUTS];
+static unsigned char nreadouts;
+
+static unsigned char asserted;
+static unsigned char latched;
+static unsigned char notifying;
+static unsigned char announcing;
+static unsigned char requested;
+static unsigned char serviced;
+
+static unsigned long edge;
+static unsigned char sampled;
+
+
+void srq_timer(void) {
+	unsigned char s = gpib_srq();
+	if (s && !sampled)
+		edge = timebase_interrupt();
+
+	sampled = s;
+}
+
+unsigned long srq_time(void) {
+	unsigned long t;
+	cli();
+	t = edge;
+	sei();
+	return t;
+}
+
+
+static void forward(unsigned address) {
+	int ch;
+
+	bus_talker(address);
+	clearerr(gpib);
+	gpib_receive();
+	gpib_attention(0);
+
+	ttyio_unsigned(ADDRESS_PRIMARY(address));
+	putchar(':');
+	while ( (ch = getc(gpib)) != EOF )
+		putchar(ch);
+
+	ttyio_end();
+}
+
+static unsigned char service(void) {
+	unsigned char matched = 0;
+	unsigned char i;
+
+	/* Take the bus from background reception */
+	request_suspend();
+
+	bus_attention();
+	gpib_putchar(GPIB_UNL);
+	gpib_putchar(GPIB_SPE);
+	for (i = 0; i < nreadouts; i++) {
+		int status = bus_poll(readouts[i].address);
+		if ( (status >= 0) && (status & GPIB_RQS) ) {
+			if ( !readouts[i].mask || (status & readouts[i].mask) )
+				matched |= _BV(i);
+		}
+	}
+
+	bus_attention();
+	gpib_putchar(GPIB_SPD);
+	gpib_putchar(GPIB_UNT);
+
+	for (i = 0; i < nreadouts; i++) {
+		if (matched & _BV(i))
+			forward(readouts[i].address);
+	}
+
+	return matched;
+}
+
+
+void srq_sample(void) {
+	unsigned char s = gpib_srq();
+	if (s && !asserted) {
+		latched = 1;
+		announcing = notifying;
+		requested = 1;
+	}
+
+	asserted = s;
+}
+
+void srq_task(void) {
+	unsigned char r;
+
+	if (scheduler_wanted())
+		/* Command line waiting */
+		return;
+
+	r = requested;
+	requested = 0;
+	if (announcing) {
+		announcing = 0;
+		fputs_P(PSTR("SRQ"), stdout);
+		ttyio_end();
+	}
+
+	/* Poll again for as long as devices are serviced */
+	if ( asserted && nreadouts && (r || serviced) )
+		serviced = service();
+	else
+		serviced = 0;
+}
+
+unsigned char srq(void) {
+	unsigned char s = latched || gpib_srq();
+	latched = 0;
+	return s;
+}
+
+void srq_notify(unsigned char notify) {
+	notifying = notify;
+}
+
+
+unsigned char srq_readout(unsigned address, unsigned char mask) {
+	unsigned char i;
+	for (i = 0; i < nreadouts; i++) {
+		if (readouts[i].address == address)
+			break;
+	}
+
+	if (i >= SRQ_READOUTS)
+		return 0;
+
+	if (i == nreadouts)
+		nreadouts++;
+
+	readouts[i].address = address;
+	readouts[i].mask = mask;
+	return 1;
+}
+
+void srq_readout_clear(void) {
+	nreadouts = 0;
+}
+
+
+void srq_prepare(void) {
+	nreadouts = 0;
+	serviced = 0;
+	asserted = 0;
+	latched = 0;
+	notifying = 0;
+	announcing = 0;
+	requested = 0;
+}
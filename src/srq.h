@@ -0,0 +1,40 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef SRQ_H
+#define SRQ_H
+
+/* Number of readout rules */
+#define SRQ_READOUTS			4
+
+
+void srq_timer(void);
+
+unsigned char srq(void);
+unsigned long srq_time(void);
+void srq_notify(unsigned char notify);
+
+unsigned char srq_readout(unsigned address, unsigned char mask);
+void srq_readout_clear(void);
+
+void srq_sample(void);
+void srq_task(void);
+void srq_prepare(void);
+
+#endif
@@ -18,6 +18,7 @@ along with this program. If not, see
 
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "io.h"
 #include "tty.h"
@@ -39,7 +40,27 @@ and end-of-file, the ttyio_flush()/gpibio_flush() routines must be used.
 */
 
 
+/* A reply prefix, such as the sample index "12:" of an acquisition, is
+held back until the reply starts. Without a reply, none is left behind. */
+static unsigned long prefix;
+static unsigned char prefixed;
+
+static void ttyio_prefixed(void) {
+	char s[11];
+	char *p;
+
+	if (!prefixed)
+		return;
+
+	prefixed = 0;
+	for (p = ultoa(prefix, s, 10); *p; p++)
+		tty_putchar(*p);
+
+	tty_putchar(':');
+}
+
 static void ttyio_put(int c) {
+	ttyio_prefixed();
 	if (c == EOF) {
 		if (configuration.langeos.nout > 0) {
 			tty_putchar(configuration.langeos.out[0]);
@@ -155,18 +176,19 @@ static int gpibio_get(void) {
 	}
 
 	if (configuration.gpibeos.nin > 0) {
-		if (c == configuration.gpibeos.in[0]) {
+		if (c == (unsigned char) configuration.gpibeos.in[0]) {
 			if ( !end && (configuration.gpibeos.nin > 1) ) {
 				c = gpib_getchar();
-				if (c == configuration.gpibeos.in[1]) {
+				if (c == (unsigned char) configuration.gpibeos.in[1]) {
 					return _FDEV_EOF;
 				}
 				else {
-					if ( gpib_end() && !gpib_received() )
+					/* A timeout ends the message after the first byte */
+					if ( (c < 0) || (gpib_end() && !gpib_received()) )
 						end = 1;
 
 					ungotten_c = c;
-					c = configuration.gpibeos.in[0];
+					c = (unsigned char) configuration.gpibeos.in[0];
 				}
 			}
 			else {
@@ -180,6 +202,22 @@ static int gpibio_get(void) {
 }
 
 
+/* Macro replay.
+The macro stream reads a single record from the EEPROM macro pool as if
+it had been received from the tty. The end of the record is reported as
+end-of-file just like an EOS sequence. */
+static unsigned macro_offset;
+static unsigned char macro_length;
+
+static int macroio_get(void) {
+	if (macro_length == 0)
+		return _FDEV_EOF;
+
+	macro_length--;
+	return configuration_macro_read(macro_offset++);
+}
+
+
 static int tty_get(FILE *f) {
 	if (feof(f))
 		return _FDEV_EOF;
@@ -206,6 +244,13 @@ static int gpib_put(char c, FILE *f) {
 	return 0;
 }
 
+static int macro_get(FILE *f) {
+	if (feof(f))
+		return _FDEV_EOF;
+	else
+		return macroio_get();
+}
+
 
 
 
@@ -214,19 +259,60 @@ void gpibio_end(void) {
 	fflush(gpib);
 }
 
+/* Numbers in replies.
+Replies are put together from strings and numbers by hand; printf_P()
+would pull vfprintf into the image. */
+void ttyio_unsigned(unsigned long u) {
+	char s[11];
+	fputs(ultoa(u, s, 10), stdout);
+}
+
+void ttyio_hex(unsigned long u, unsigned char digits) {
+	while (digits--) {
+		unsigned char d = (u >> (4 * digits)) & 0xF;
+		putchar((d < 10) ? '0' + d : 'A' - 10 + d);
+	}
+}
+
 void ttyio_end(void) {
 	ttyio_put(EOF);
 	fflush(stdout);
 }
 
+void ttyio_prefix(unsigned long u) {
+	prefix = u;
+	prefixed = 1;
+}
+
+void ttyio_unprefix(void) {
+	prefixed = 0;
+}
+
+/* Binary data bypasses the stream, which would take 0xFF for EOF */
+void ttyio_raw(unsigned char c) {
+	ttyio_prefixed();
+	tty_putchar(c);
+}
+
+void macroio_open(unsigned offset, unsigned char length) {
+	macro_offset = offset;
+	macro_length = length;
+	clearerr(macro);
+}
+
 
 static FILE ttyio_file = FDEV_SETUP_STREAM(tty_put, tty_get, _FDEV_SETUP_RW);
 static FILE gpibio_file = FDEV_SETUP_STREAM(gpib_put, gpib_get, _FDEV_SETUP_RW);
+static FILE macroio_file = FDEV_SETUP_STREAM(NULL, macro_get, _FDEV_SETUP_READ);
 FILE *gpib;
+FILE *macro;
 
 void streams_prepare(void) {
 	stdin = &ttyio_file;
 	stdout = &ttyio_file;
 
 	gpib = &gpibio_file;
+	macro = &macroio_file;
+
+	prefixed = 0;
 }
@@ -23,9 +23,16 @@ along with this program. If not, see
 #include <stdio.h>
 
 extern FILE *gpib;
+extern FILE *macro;
 
 void gpibio_end(void);
+void ttyio_unsigned(unsigned long u);
+void ttyio_hex(unsigned long u, unsigned char digits);
 void ttyio_end(void);
+void ttyio_prefix(unsigned long u);
+void ttyio_unprefix(void);
+void ttyio_raw(unsigned char c);
+void macroio_open(unsigned offset, unsigned char length);
 
 void streams_prepare(void);
 
@@ -18,7 +18,10 @@ along with this program. If not, see
 
 
 #include <ctype.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
@@ -28,9 +31,30 @@ along with this program. If not, see
 #include "configuration.h"
 #include "tty.h"
 #include "streams.h"
+#include "bus.h"
+#include "request.h"
+#include "srq.h"
+#include "scheduler.h"
+#include "acquire.h"
+#include "reading.h"
+#include "watch.h"
+#include "pack.h"
+#include "timebase.h"
+#include "counters.h"
+#include "profile.h"
+#include "handshake.h"
+#include "trace.h"
+#include "memory.h"
+#include "bench.h"
 #include "terminal.h"
 
 static unsigned char online;
+static unsigned char errtrap;
+
+/* Macro recording and replay */
+static unsigned char defining;
+static unsigned char running;
+static unsigned char stamping;
 
 
 
@@ -55,6 +79,9 @@ struct token_t {
 	char name[10];
 };
 
+/* Macros store commands by these values, so new commands are appended
+and the values stay fixed. Only command_tokens is kept in order. A change
+of the values requires a new CONFIGURATION_MACRO_VERSION. */
 enum command_token_e {
 	command_ = 0,
 	command_abort,
@@ -79,34 +106,112 @@ enum command_token_e {
 	command_status,
 	command_timeout,
 	command_trigger,
+	command_define,
+	command_end,
+	command_run,
+	command_tasks,
+	command_srq,
+	command_acquire,
+	command_sweep,
+	command_watch,
+	command_format,
+	command_time,
+	command_profile,
+	command_handshake,
+	command_trace,
+	command_memory,
+	command_bench,
+	command_monitor,
+	command_listen,
 };
 
 static const struct token_t PROGMEM command_tokens[] = {
+	{ command_watch, "WATCH" },
 	{ command_trigger, "TRIGGER" },
+	{ command_trace, "TRACE" },
 	{ command_timeout, "TIMEOUT" },
+	{ command_time, "TIME" },
+	{ command_tasks, "TASKS" },
+	{ command_sweep, "SWEEP" },
 	{ command_status, "STATUS" },
+	{ command_srq, "SRQ" },
 	{ command_spoll, "SPOLL" },
 	{ command_send, "SEND" },
+	{ command_run, "RUN" },
 	{ command_response, "RESPONSE" },
 	{ command_reset, "RESET" },
 	{ command_request, "REQUEST" },
 	{ command_remote, "REMOTE" },
+#ifdef PROFILE
+	{ command_profile, "PROFILE" },
+#endif
 	{ command_ppoll, "PPOLL" },
 	{ command_pass, "PASS" },
 	{ command_output, "OUTPUT" },
 	{ command_online, "ONLINE" },
 	{ command_offline, "OFFLINE" },
+	{ command_monitor, "MONITOR" },
+	{ command_memory, "MEMORY" },
 	{ command_local, "LOCAL" },
+	{ command_listen, "LISTEN" },
 	{ command_langeos, "LANGEOS" },
+#ifdef PROFILE
+	{ command_handshake, "HANDSHAKE" },
+#endif
 	{ command_gpibeos, "GPIBEOS" },
+	{ command_format, "FORMAT" },
 	{ command_errtrap, "ERRTRAP" },
+	{ command_end, "END" },
 	{ command_enter, "ENTER" },
+	{ command_define, "DEFINE" },
 	{ command_configure, "CONFIGURE" },
 	{ command_clear, "CLEAR" },
+	{ command_bench, "BENCH" },
+	{ command_acquire, "ACQUIRE" },
 	{ command_abort, "ABORT" },
 };
 
 
+enum switch_token_e {
+	switch_ = 0,
+	switch_on,
+	switch_off,
+};
+
+static const struct token_t PROGMEM switch_tokens[] = {
+	{ switch_on, "ON" },
+	{ switch_off, "OFF" },
+};
+
+
+enum srq_token_e {
+	srq_ = 0,
+	srq_on,
+	srq_off,
+	srq_enter,
+	srq_clear,
+};
+
+static const struct token_t PROGMEM srq_tokens[] = {
+	{ srq_on, "ON" },
+	{ srq_off, "OFF" },
+	{ srq_enter, "ENTER" },
+	{ srq_clear, "CLEAR" },
+};
+
+
+enum ppoll_token_e {
+	ppoll_ = 0,
+	ppoll_unconfig,
+	ppoll_config,
+};
+
+static const struct token_t PROGMEM ppoll_tokens[] = {
+	{ ppoll_unconfig, "UNCONFIG" },
+	{ ppoll_config, "CONFIG" },
+};
+
+
 enum local_token_e {
 	local_ = 0,
 	local_lockout,
@@ -117,6 +222,16 @@ static const struct token_t PROGMEM local_tokens[] = {
 };
 
 
+enum listen_token_e {
+	listen_ = 0,
+	listen_only,
+};
+
+static const struct token_t PROGMEM listen_tokens[] = {
+	{ listen_only, "ONLY" },
+};
+
+
 enum eos_token_e {
 	eos_ = 0,
 	eos_out,
@@ -151,6 +266,80 @@ static const struct token_t PROGMEM output_tokens[] = {
 };
 
 
+enum enter_token_e {
+	enter_ = 0,
+	enter_avg,
+	enter_pack,
+};
+
+static const struct token_t PROGMEM enter_tokens[] = {
+	{ enter_pack, "PACK" },
+	{ enter_avg, "AVG" },
+};
+
+
+enum watch_token_e {
+	watch_ = 0,
+	watch_on,
+	watch_off,
+	watch_clear,
+};
+
+static const struct token_t PROGMEM watch_tokens[] = {
+	{ watch_on, "ON" },
+	{ watch_off, "OFF" },
+	{ watch_clear, "CLEAR" },
+};
+
+
+enum format_token_e {
+	format_ = 0,
+	format_ascii,
+	format_float,
+	format_int,
+};
+
+static const struct token_t PROGMEM format_tokens[] = {
+	{ format_int, "INT" },
+	{ format_float, "FLOAT" },
+	{ format_ascii, "ASCII" },
+};
+
+
+enum bench_token_e {
+	bench_ = 0,
+	bench_output,
+	bench_enter,
+};
+
+static const struct token_t PROGMEM bench_tokens[] = {
+	{ bench_output, "OUTPUT" },
+	{ bench_enter, "ENTER" },
+};
+
+
+enum timeout_token_e {
+	timeout_ = 0,
+	timeout_device,
+	timeout_clear,
+};
+
+static const struct token_t PROGMEM timeout_tokens[] = {
+	{ timeout_device, "DEVICE" },
+	{ timeout_clear, "CLEAR" },
+};
+
+
+enum status_token_e {
+	status_ = 0,
+	status_reset,
+};
+
+static const struct token_t PROGMEM status_tokens[] = {
+	{ status_reset, "RESET" },
+};
+
+
 static void chomp(void) {
 	int ch;
 	do {
@@ -208,41 +397,227 @@ unsigned char token(const struct token_t *tokens, unsigned char ntokens) {
 }
 
 
+/* Numeric parser.
+This takes the place of scanf_P() on the command path. Digits are taken
+from stdin one at a time, so the EOS handling of the stream layer stays
+in effect and the character terminating a number is pushed back for the
+next stage, just like scanf() would do. Leading white space is skipped;
+overlong numbers saturate instead of wrapping around.
+
+Device addresses are given as decimal primary addresses. A secondary
+address may be appended in the HP manner as two more digits, e.g. 502 or
+0502 is primary address 5 with secondary address 2. The parsed address
+is encoded as described in bus.h. */
+
+static unsigned char expect(char c) {
+	int ch = getchar();
+	if (ch == c) {
+		return 1;
+	}
+	else {
+		ungetc(ch, stdin);
+		return 0;
+	}
+}
+
+static unsigned char comma(void) {
+	chomp();
+	return expect(',');
+}
+
+static unsigned char number(unsigned *u) {
+	unsigned char digits = 0;
+	unsigned n = 0;
+	int ch;
+
+	chomp();
+	while ( isdigit(ch = getchar()) ) {
+		if (n > (UINT_MAX - 9) / 10)
+			n = UINT_MAX;
+		else
+			n = 10 * n + (ch - '0');
+
+		digits++;
+	}
+
+	ungetc(ch, stdin);
+	if (digits)
+		*u = n;
+
+	return digits > 0;
+}
+
+static unsigned char address(unsigned *a) {
+	unsigned u;
+	if (!number(&u))
+		return 0;
+
+	unsigned primary = u;
+	unsigned secondary = 0;
+	if (u > 99) {
+		/* Trailing secondary address */
+		primary = u / 100;
+		secondary = u % 100;
+		if (secondary > GPIB_MAX_ADDRESS) {
+			ERROR(TERMINAL_ERROR);
+			return 0;
+		}
+
+		secondary = GPIB_SAGROUP(secondary);
+	}
+
+	if (primary > GPIB_MAX_ADDRESS) {
+		ERROR(TERMINAL_ERROR);
+		return 0;
+	}
+
+	*a = primary | (secondary << 8);
+	return 1;
+}
+
+static unsigned char count(unsigned *length) {
+	if (!expect('#'))
+		return 0;
+
+	if (!number(length)) {
+		ERROR(TERMINAL_ERROR);
+		return 0;
+	}
+
+	return 1;
+}
+
+static unsigned char chr(unsigned *u) {
+	return expect('(') && number(u) && expect(')') && (*u <= 0xFF);
+}
 
+static unsigned char name(char *s) {
+	unsigned char i = 0;
+	int ch;
 
+	chomp();
+	while ( isalnum(ch = getchar()) ) {
+		if (i >= CONFIGURATION_MACRO_NAME) {
+			ERROR(TERMINAL_ERROR);
+			return 0;
+		}
 
+		s[i++] = toupper(ch);
+	}
 
-static void attention(void) {
-	gpib_transmit();
-	fflush(gpib);
-	gpib_attention(1);
+	ungetc(ch, stdin);
+	s[i] = '\0';
+	return i > 0;
 }
 
+
+
+
+
+
 static char listeners(void) {
 	/* Unadress talkers */
 	gpib_putchar(GPIB_UNT);
 
 	/* Address listeners */
-	unsigned ch = '\0';
-	unsigned address = GPIB_MAX_ADDRESS + 1;
+	unsigned char addressed = 0;
+	unsigned a;
+	int ch;
 	do {
-		if (scanf_P(PSTR("%u"), &address) == 1) {
+		if (address(&a)) {
 			chomp();
-			if (address > GPIB_MAX_ADDRESS) {
-				ERROR(TERMINAL_ERROR);
-			}
-			else {
-				if (ch != ',')
-					/* Discard previous listeners */
-					gpib_putchar(GPIB_UNL);
+			if (!addressed)
+				/* Discard previous listeners */
+				gpib_putchar(GPIB_UNL);
 
-				gpib_putchar(GPIB_LAGROUP(address));
-			}
+			bus_listener(a);
+			addressed = 1;
+		}
+	} while ( (ch = getchar()) == ',' );
+
+	ungetc(ch, stdin);
+	return addressed;
+}
+
+
+static void spoll(void) {
+	unsigned char polled = 0;
+	unsigned a;
+	int ch;
+
+	/* Single serial poll session */
+	bus_attention();
+	gpib_putchar(GPIB_UNL);
+	gpib_putchar(GPIB_SPE);
+
+	do {
+		if (address(&a)) {
+			int status = bus_poll(a);
+			if (polled++)
+				putchar(',');
+
+			if (status >= 0)
+				ttyio_unsigned(status);
 		}
+
+		chomp();
 	} while ( (ch = getchar()) == ',' );
 
 	ungetc(ch, stdin);
-	return address < (GPIB_MAX_ADDRESS + 1);
+
+	bus_attention();
+	gpib_putchar(GPIB_SPD);
+	gpib_putchar(GPIB_UNT);
+
+	if (polled)
+		ttyio_end();
+	else
+		ERROR(TERMINAL_ERROR);
+}
+
+
+static void ppoll(void) {
+	unsigned a;
+	unsigned line;
+	unsigned sense;
+
+	switch (token(ppoll_tokens, N_VECTOR(ppoll_tokens))) {
+		case ppoll_config:
+			/* Address, response line 1..8, sense */
+			if ( !address(&a) || !comma() ||
+				!number(&line) || !comma() ||
+				!number(&sense) ||
+				(line < 1) || (line > 8) || (sense > 1) ) {
+				ERROR(TERMINAL_ERROR);
+				break;
+			}
+
+			bus_attention();
+			gpib_putchar(GPIB_UNL);
+			bus_listener(a);
+			gpib_putchar(GPIB_PPC);
+			gpib_putchar(GPIB_PPE(sense, line));
+			gpib_putchar(GPIB_UNL);
+			break;
+
+		case ppoll_unconfig:
+			bus_attention();
+			if (listeners()) {
+				gpib_putchar(GPIB_PPC);
+				gpib_putchar(GPIB_PPD);
+				gpib_putchar(GPIB_UNL);
+			}
+			else {
+				gpib_putchar(GPIB_PPU);
+			}
+			break;
+
+		default:
+			/* Identify */
+			ttyio_unsigned(gpib_ppoll());
+			ttyio_end();
+			break;
+	}
 }
 
 
@@ -303,7 +678,7 @@ static void eos(struct configuration_eos_t *eos, unsigned char *ineoi, unsigned
 				break;
 
 			case eos_chr:
-				if (scanf_P(PSTR("(%u)"), &u) == 1) {
+				if (chr(&u)) {
 					ch = u;
 				}
 				else {
@@ -373,17 +748,11 @@ static void eos(struct configuration_eos_t *eos, unsigned char *ineoi, unsigned
 static void output(void) {
 	int ch;
 	unsigned length;
-	unsigned char limited = 0;
+	unsigned char limited;
 
 	chomp();
-	if ( (ch = getchar()) == '#' ) {
-		if (scanf_P(PSTR("%u"), &length) == 1)
-			limited = 1;
-		else
-			ERROR(TERMINAL_ERROR);
-
-		ch = getchar();
-	}
+	limited = count(&length);
+	ch = getchar();
 
 	
 	unsigned char end = 0;
@@ -393,7 +762,8 @@ static void output(void) {
 		if (end != configuration.gpibeos_outeoi) {
 			/* Switch on or off */
 			fflush(gpib);
-			while (!gpib_transmitted());
+			while (!gpib_transmitted())
+				scheduler_yield();
 
 			configuration.gpibeos_outeoi = end;
 			end = !end;
@@ -432,48 +802,111 @@ static void output(void) {
 	if (end != configuration.gpibeos_outeoi) {
 		/* Restore default */
 		fflush(gpib);
-		while (!gpib_transmitted());
+		while (!gpib_transmitted())
+			scheduler_yield();
 
 		configuration.gpibeos_outeoi = end;
 	}
 }
 
 
+/* Summary of repeated readings: mean,min,max,deviation. The device is
+addressed again for every reading, which triggers most instruments. */
+static void average(unsigned char addressed, unsigned a, unsigned n) {
+	struct statistics_t stat;
+	char s[15];
+	double x;
+	unsigned i;
+
+	/* The talker has been addressed by enter() for the first sample */
+	statistics_clear(&stat);
+	for (i = 0; i < n; i++) {
+		if (addressed && i)
+			bus_talker(a);
+
+		clearerr(gpib);
+		gpib_receive();
+		gpib_attention(0);
+		if (!reading(gpib, &x)) {
+			ERROR(TERMINAL_ERROR);
+			return;
+		}
+
+		statistics_add(&stat, x);
+		if ( (VOLATILE(unsigned, red_pattern) != NO_ERROR) || tty_received() )
+			break;
+	}
+
+	fputs(dtostre(stat.mean, s, 7, DTOSTR_PLUS_SIGN | DTOSTR_UPPERCASE), stdout);
+	putchar(',');
+	fputs(dtostre(stat.min, s, 7, DTOSTR_PLUS_SIGN | DTOSTR_UPPERCASE), stdout);
+	putchar(',');
+	fputs(dtostre(stat.max, s, 7, DTOSTR_PLUS_SIGN | DTOSTR_UPPERCASE), stdout);
+	putchar(',');
+	fputs(dtostre(statistics_deviation(&stat), s, 7, DTOSTR_PLUS_SIGN | DTOSTR_UPPERCASE), stdout);
+	ttyio_end();
+}
+
 static void enter(void) {
 	int ch;
 	unsigned length;
-	unsigned char limited = 0;
+	unsigned char limited;
 
-	unsigned address;
-	if (scanf_P(PSTR("%u"), &address) == 1) {
-		if (address > GPIB_MAX_ADDRESS) {
-			ERROR(TERMINAL_ERROR);
-		}
-		else {
-			/* Adress single device */
-			attention();
-			gpib_putchar(GPIB_UNT);
-			gpib_putchar(GPIB_TAGROUP(address));
-		}
+	unsigned a;
+	unsigned char addressed = address(&a);
+	if (addressed)
+		/* Adress single device */
+		bus_talker(a);
+
+
+	switch (token(enter_tokens, N_VECTOR(enter_tokens))) {
+		case enter_avg:
+			if ( !number(&length) || !length ) {
+				ERROR(TERMINAL_ERROR);
+				return;
+			}
+
+			average(addressed, a, length);
+			return;
+
+		case enter_pack:
+			clearerr(gpib);
+			gpib_receive();
+			gpib_attention(0);
+			pack();
+			return;
 	}
 
 
 	chomp();
-	if ( (ch = getchar()) == '#' ) {
-		if (scanf_P(PSTR("%u"), &length) == 1)
-			limited = 1;
-		else
-			ERROR(TERMINAL_ERROR);
-	}
-	else {
-		ungetc(ch, stdin);
-	}
+	limited = count(&length);
 
 
 	/* Listen */
 	clearerr(gpib);
 	gpib_receive();
 	gpib_attention(0);
+	if ( !limited && reading_binary() ) {
+		reading_forward(gpib);
+		return;
+	}
+
+	if (stamping) {
+		/* Time of the first byte, if there is any */
+		gpib_restamp();
+		if ( (ch = getc(gpib)) == EOF ) {
+			if (limited)
+				ERROR(TERMINAL_ERROR);
+
+			ttyio_end();
+			return;
+		}
+
+		ungetc(ch, gpib);
+		ttyio_unsigned(gpib_first());
+		putchar(':');
+	}
+
 	if (limited) {
 		while (length--) {
 			if ( (ch = getc(gpib)) != EOF )
@@ -491,79 +924,859 @@ static void enter(void) {
 }
 
 
-void terminal(void) {
-	clearerr(stdin);
-	unsigned char t = token(command_tokens, N_VECTOR(command_tokens));
-	if (!t) {
-		if (!feof(stdin)) {
-			/* Garbage */
-			ERROR(TERMINAL_ERROR);
-			getchar();
-		}
+static void runtimes(void) {
+	unsigned char task;
+	for (task = 0; task <= ntasks; task++) {
+		if (task)
+			putchar(',');
 
-		return;
+		fputs_P(scheduler_name(task), stdout);
+		putchar(' ');
+		ttyio_unsigned(scheduler_runtime(task));
 	}
 
-	ERROR(NO_ERROR);
-	switch (t) {
-		case command_offline:
-			gpib_passive();
-			online = 0;
-			break;
+	ttyio_end();
+}
 
-		case command_online:
-			gpib_control();
-			online = 1;
-			break;
 
-		case command_abort:
-			gpib_passive();
-			gpib_control();
-			online = 1;
-			gpib_clear();
-			gpib_attention(1);
-			break;
+/* Named value of a reply, e.g. ",STALLS 3" */
+static void field(PGM_P name, unsigned long value) {
+	fputs_P(name, stdout);
+	ttyio_unsigned(value);
+}
 
-		case command_reset:
-			configuration_default();
-			configuration_store();
-			break;
+static void statistics(void) {
+	struct counters_t c;
 
+	if (token(status_tokens, N_VECTOR(status_tokens)) == status_reset) {
+		counters_reset();
+		return;
+	}
 
-		case command_langeos:
-			eos(
-				&configuration.langeos,
-				NULL,
-				NULL
-			);
+	counters_read(&c);
+	field(PSTR("TTYIN "), c.tty_in);
+	field(PSTR(",TTYOUT "), c.tty_out);
+	field(PSTR(",GPIBIN "), c.gpib_in);
+	field(PSTR(",GPIBOUT "), c.gpib_out);
+	field(PSTR(",TTYOVF "), c.tty_overflows);
+	field(PSTR(",TTYERR "), c.tty_errors);
+	field(PSTR(",CTS "), c.tty_throttles);
+	field(PSTR(",GPIBOVF "), c.gpib_overflows);
+	field(PSTR(",TIMEOUT "), c.gpib_timeouts);
+	field(PSTR(",TXSTALL "), c.gpib_tx_stalls);
+	field(PSTR(",RXSTALL "), c.gpib_rx_stalls);
+	field(PSTR(",TTYRX "), c.tty_rx_peak);
+	field(PSTR(",TTYTX "), c.tty_tx_peak);
+	field(PSTR(",GPIBRX "), c.gpib_rx_peak);
+	field(PSTR(",GPIBTX "), c.gpib_tx_peak);
+	ttyio_end();
+}
 
-			configuration_store();
-			break;
 
-		case command_gpibeos:
-			eos(
-				&configuration.gpibeos,
-				&configuration.gpibeos_ineoi,
-				&configuration.gpibeos_outeoi
-			);
+static void memory(void) {
+	field(PSTR("STATIC "), memory_static());
+	field(PSTR(",STACK "), memory_peak());
+	field(PSTR(",FREE "), memory_headroom());
+	ttyio_end();
+}
 
-			configuration_store();
-			break;
+/* End everything running in the background */
+static void cancel(void) {
+	request_cancel();
+	acquire_stop();
+	watch_stop();
+}
 
+static void offline(void) {
+	cancel();
+	gpib_passive();
+	online = 0;
+}
 
-		default:
-			if (!online) {
-				ERROR(TERMINAL_ERROR);
-				return;
-			}
+static void monitor(void) {
+	struct gpib_record_t r;
+	unsigned n;
 
-			/* Online-only commands */
-			switch (t) {
-				case command_clear:
+	offline();
+	gpib_monitor(1);
+
+	while (!tty_received()) {
+		if (gpib_record(&r)) {
+			ttyio_hex(r.time, 8);
+			putchar(' ');
+			putchar((r.flags & GPIB_RECORD_ATN) ? 'C' : 'D');
+			ttyio_hex(r.data, 2);
+			if (r.flags & GPIB_RECORD_EOI)
+				fputs_P(PSTR(" EOI"), stdout);
+
+			ttyio_end();
+		}
+		else if ( (n = gpib_lost()) ) {
+			field(PSTR("LOST "), n);
+			ttyio_end();
+		}
+		else {
+			scheduler_yield();
+		}
+	}
+
+	gpib_monitor(0);
+}
+
+/* Data is passed through unchanged; the tty holds the receiver back
+when the host is slower than the talker */
+static void listen(void) {
+	if (token(listen_tokens, N_VECTOR(listen_tokens)) != listen_only) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	offline();
+	gpib_listen();
+
+	while (!tty_received()) {
+		if (gpib_received())
+			tty_putchar(gpib_getchar());
+		else
+			scheduler_yield();
+	}
+
+	gpib_passive();
+}
+
+static void traces(void) {
+	struct trace_t t;
+	unsigned char i;
+
+	if (token(status_tokens, N_VECTOR(status_tokens)) == status_reset) {
+		trace_reset();
+		return;
+	}
+
+	for (i = 0; trace_read(i, &t); i++) {
+		if (t.event == trace_none)
+			continue;
+
+		ttyio_unsigned(t.time);
+		putchar(' ');
+		fputs_P(trace_name(t.event), stdout);
+		putchar(' ');
+		ttyio_hex(t.data, 2);
+		ttyio_end();
+	}
+}
+
+
+#ifdef PROFILE
+static void profile(void) {
+	unsigned buckets[PROFILE_BUCKETS];
+	unsigned char vector;
+	unsigned char i;
+
+	if (token(status_tokens, N_VECTOR(status_tokens)) == status_reset) {
+		profile_reset();
+		return;
+	}
+
+	for (vector = 0; vector < PROFILE_VECTORS; vector++) {
+		profile_histogram(vector, buckets);
+
+		fputs_P(profile_name(vector), stdout);
+		for (i = 0; i < PROFILE_BUCKETS; i++) {
+			putchar(i ? ',' : ' ');
+			ttyio_unsigned(buckets[i]);
+		}
+
+		ttyio_end();
+	}
+}
+
+static void latency(PGM_P name, const struct latency_t *l) {
+	putchar(' ');
+	fputs_P(name, stdout);
+	putchar(' ');
+	if (l->n) {
+		ttyio_unsigned(l->min);
+		putchar('/');
+		ttyio_unsigned(l->sum / l->n);
+		putchar('/');
+		ttyio_unsigned(l->max);
+	}
+	else {
+		putchar('-');
+	}
+}
+
+static void handshakes(void) {
+	struct handshake_listeners_t l;
+	struct handshake_talker_t t;
+	unsigned char i;
+
+	if (token(status_tokens, N_VECTOR(status_tokens)) == status_reset) {
+		handshake_reset();
+		return;
+	}
+
+	for (i = 0; handshake_listeners(i, &l); i++) {
+		unsigned char a;
+		unsigned char first = 1;
+
+		fputs_P(PSTR("LISTEN"), stdout);
+		for (a = 0; a <= GPIB_MAX_ADDRESS; a++) {
+			if (l.set & (1UL << a)) {
+				putchar(first ? ' ' : ',');
+				ttyio_unsigned(a);
+				first = 0;
+			}
+		}
+
+		latency(PSTR("NDAC"), &l.ndac);
+		latency(PSTR("NRFD"), &l.nrfd);
+		ttyio_end();
+	}
+
+	for (i = 0; handshake_talker(i, &t); i++) {
+		field(PSTR("TALK "), t.address);
+		latency(PSTR("DAV"), &t.dav);
+		ttyio_end();
+	}
+}
+#endif
+
+
+/* Command macros.
+Between DEFINE name and END, lines are not executed but recorded, and
+END stores the macro in the EEPROM macro pool. END has to be spelled
+out, since its abbreviations stand for ENTER and are recorded. Whatever
+follows DEFINE on its own line is recorded as well. The leading command
+of each line is stored as its token, the remainder verbatim. RUN name
+[count] replays the macro by feeding each record to batch() through the
+macro stream in place of stdin. Macros cannot be defined or run from
+within a macro. */
+static unsigned char batch(unsigned char t);
+
+static void define(void) {
+	char s[CONFIGURATION_MACRO_NAME + 1];
+	if ( running || !name(s) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	configuration_macro_define(s);
+	defining = 1;
+}
+
+static void record(unsigned char t) {
+	int ch;
+
+	ERROR(NO_ERROR);
+	if (t == command_end) {
+		defining = 0;
+
+		chomp();
+		if ( !feof(stdin) || !configuration_macro_end() )
+			ERROR(TERMINAL_ERROR);
+	}
+	else if (t) {
+		unsigned char stored = configuration_macro_record(t);
+
+		chomp();
+		while ( stored && ((ch = getchar()) != EOF) )
+			stored = configuration_macro_put(ch);
+
+		if (stored) {
+			configuration_macro_commit();
+		}
+		else {
+			/* Pool exhausted or line too long */
+			configuration_macro_abort();
+			defining = 0;
+			ERROR(TERMINAL_ERROR);
+		}
+	}
+	else if (!feof(stdin)) {
+		/* Garbage */
+		ERROR(TERMINAL_ERROR);
+	}
+}
+
+static unsigned char replay(unsigned offset) {
+	FILE *in = stdin;
+	unsigned char length;
+
+	ERROR(NO_ERROR);
+	running = 1;
+	while ( (length = configuration_macro_read(offset)) ) {
+		macroio_open(offset + 2, length - 1);
+		stdin = macro;
+		batch(configuration_macro_read(offset + 1));
+		stdin = in;
+
+		if (VOLATILE(unsigned, red_pattern) != NO_ERROR)
+			break;
+
+		offset += length + 1;
+	}
+
+	running = 0;
+	return !length;
+}
+
+static void run(void) {
+	char s[CONFIGURATION_MACRO_NAME + 1];
+	unsigned n = 1;
+	unsigned first;
+
+	if ( running || !name(s) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	number(&n);
+	if ( (first = configuration_macro(s)) == CONFIGURATION_MACRO_NONE ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+
+	while ( n-- && replay(first) );
+}
+
+
+/* Parameter sweep.
+SWEEP start,stop,step[,name] address;template
+
+For each value from start to stop, the template is sent to the device
+with every placeholder replaced by the value. Then the macro, if given,
+is run to take the reading. Values are fixed point decimals and are
+printed with as many decimals as the most precise of start, stop and
+step. The sweep ends early at the first failing command or as soon as
+anything is received from the host. */
+#define SWEEP_PLACEHOLDER	'@'
+#define SWEEP_TEMPLATE		32
+#define SWEEP_DECIMALS		4
+
+struct decimal_t {
+	long value;
+	unsigned char decimals;
+};
+
+static unsigned char decimal(struct decimal_t *d, unsigned char decimals) {
+	unsigned char digits = 0;
+	unsigned char point = 0;
+	unsigned char negative;
+	long n = 0;
+	int ch;
+
+	chomp();
+	negative = expect('-');
+
+	d->decimals = 0;
+	while ( isdigit(ch = getchar()) || ((ch == '.') && !point) ) {
+		if (ch == '.') {
+			point = 1;
+			continue;
+		}
+
+		if ( (n > (LONG_MAX - 9) / 10) || (point && (d->decimals >= decimals)) ) {
+			ERROR(TERMINAL_ERROR);
+			return 0;
+		}
+
+		n = 10 * n + (ch - '0');
+		digits++;
+		if (point)
+			d->decimals++;
+	}
+
+	ungetc(ch, stdin);
+	d->value = negative ? -n : n;
+	return digits > 0;
+}
+
+static unsigned char scale(struct decimal_t *d, unsigned char decimals) {
+	while (d->decimals < decimals) {
+		if ( (d->value > LONG_MAX / 10) || (d->value < -LONG_MAX / 10) )
+			return 0;
+
+		d->value *= 10;
+		d->decimals++;
+	}
+
+	return 1;
+}
+
+static void sweep_put(long v, unsigned char decimals) {
+	unsigned long p = 1;
+	unsigned long u = v;
+	char s[11];
+	while (decimals--)
+		p *= 10;
+
+	if (v < 0) {
+		putc('-', gpib);
+		u = -v;
+	}
+
+	fputs(ultoa(u / p, s, 10), gpib);
+	if (p > 1) {
+		putc('.', gpib);
+		while (p /= 10)
+			putc('0' + (u / p) % 10, gpib);
+	}
+}
+
+static void sweep(void) {
+	struct decimal_t start, stop, step;
+	char s[CONFIGURATION_MACRO_NAME + 1];
+	char template[SWEEP_TEMPLATE];
+	unsigned first = CONFIGURATION_MACRO_NONE;
+	unsigned char length = 0;
+	unsigned char decimals;
+	unsigned char down;
+	unsigned long left;
+	unsigned a;
+	long v;
+	int ch;
+
+	if ( running ||
+		!decimal(&start, SWEEP_DECIMALS) ||
+		!comma() || !decimal(&stop, SWEEP_DECIMALS) ||
+		!comma() || !decimal(&step, SWEEP_DECIMALS) || (step.value <= 0) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	if ( comma() && (!name(s) || ((first = configuration_macro(s)) == CONFIGURATION_MACRO_NONE)) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	if (!address(&a)) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	chomp();
+	if (!expect(';')) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	while ( (ch = getchar()) != EOF ) {
+		if (length >= SWEEP_TEMPLATE) {
+			ERROR(TERMINAL_ERROR);
+			return;
+		}
+
+		template[length++] = ch;
+	}
+
+
+	decimals = start.decimals;
+	if (stop.decimals > decimals)
+		decimals = stop.decimals;
+	if (step.decimals > decimals)
+		decimals = step.decimals;
+
+	if ( !scale(&start, decimals) || !scale(&stop, decimals) || !scale(&step, decimals) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	down = (stop.value < start.value);
+	for (v = start.value; ; v += down ? -step.value : step.value) {
+		unsigned char i;
+
+		bus_attention();
+		gpib_putchar(GPIB_UNT);
+		gpib_putchar(GPIB_UNL);
+		bus_listener(a);
+		fflush(gpib);
+		gpib_attention(0);
+
+		for (i = 0; i < length; i++) {
+			if (template[i] == SWEEP_PLACEHOLDER)
+				sweep_put(v, decimals);
+			else
+				putc(template[i], gpib);
+		}
+
+		gpibio_end();
+
+		if (first != CONFIGURATION_MACRO_NONE)
+			replay(first);
+
+		if ( (VOLATILE(unsigned, red_pattern) != NO_ERROR) || tty_received() )
+			break;
+
+		/* Distance left, unsigned as it may exceed LONG_MAX */
+		left = down ?
+			(unsigned long) v - (unsigned long) stop.value :
+			(unsigned long) stop.value - (unsigned long) v;
+		if (left < (unsigned long) step.value)
+			break;
+	}
+}
+
+
+/* Change detection: WATCH address,deadband[,low,high] adds a device,
+WATCH ON period starts reading the devices every period milliseconds.
+Deadbands, limits and scales take up to REAL_DECIMALS decimals. */
+#define REAL_DECIMALS		6
+
+static unsigned char real(double *x) {
+	struct decimal_t d;
+	if (!decimal(&d, REAL_DECIMALS))
+		return 0;
+
+	*x = d.value;
+	while (d.decimals--)
+		*x /= 10;
+
+	return 1;
+}
+
+static void watching(void) {
+	double deadband;
+	double low = -INFINITY;
+	double high = INFINITY;
+	unsigned u;
+
+	switch (token(watch_tokens, N_VECTOR(watch_tokens))) {
+		case watch_on:
+			if ( !number(&u) || !u )
+				ERROR(TERMINAL_ERROR);
+			else
+				watch_start(u);
+			break;
+
+		case watch_off:
+			watch_stop();
+			break;
+
+		case watch_clear:
+			watch_stop();
+			watch_forget();
+			break;
+
+		default:
+			if ( !address(&u) ||
+				!comma() || !real(&deadband) ||
+				(comma() && (!real(&low) || !comma() || !real(&high))) ||
+				!watch_device(u, deadband, low, high) )
+				ERROR(TERMINAL_ERROR);
+			break;
+	}
+}
+
+
+/* Timestamps in us: TIME reports the current time and the times of the
+first and the last byte received and of the latest SRQ. TIME ON prefixes
+ENTER replies with the time of their first byte. */
+static void times(void) {
+	switch (token(switch_tokens, N_VECTOR(switch_tokens))) {
+		case switch_on:
+			stamping = 1;
+			break;
+
+		case switch_off:
+			stamping = 0;
+			break;
+
+		default:
+			ttyio_unsigned(timebase());
+			putchar(',');
+			ttyio_unsigned(gpib_first());
+			putchar(',');
+			ttyio_unsigned(gpib_last());
+			putchar(',');
+			ttyio_unsigned(srq_time());
+			ttyio_end();
+			break;
+	}
+}
+
+
+/* Bus throughput: BENCH OUTPUT|ENTER address[,]n. */
+static void bench(void) {
+	struct bench_t b;
+	unsigned char t;
+	unsigned a;
+	unsigned n;
+
+	t = token(bench_tokens, N_VECTOR(bench_tokens));
+	if ( !t || !address(&a) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	comma();
+	if ( !number(&n) || !n ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	if (t == bench_output)
+		bench_transmit(a, n, &b);
+	else
+		bench_receive(a, n, &b);
+
+	field(PSTR("BYTES "), b.bytes);
+	field(PSTR(",TIME "), b.time);
+	field(PSTR(",RATE "), b.time ? (unsigned long) (b.bytes * 1e6 / b.time) : 0UL);
+	field(PSTR(",STALLS "), b.stalls);
+	ttyio_end();
+}
+
+
+/* Timeouts in ms: TIMEOUT [DEVICE address,]byte[,message]. A message
+timeout of zero disables the message deadline. */
+static void timeout(void) {
+	unsigned a = BUS_DEFAULT;
+	unsigned byte;
+	unsigned message = 0;
+
+	switch (token(timeout_tokens, N_VECTOR(timeout_tokens))) {
+		case timeout_clear:
+			bus_timeouts_clear();
+			return;
+
+		case timeout_device:
+			if ( !address(&a) || !comma() ) {
+				ERROR(TERMINAL_ERROR);
+				return;
+			}
+			break;
+
+		default:
+			chomp();
+			if (feof(stdin)) {
+				ttyio_unsigned(bus_timeout_byte());
+				putchar(',');
+				ttyio_unsigned(bus_timeout_message());
+				ttyio_end();
+				return;
+			}
+			break;
+	}
+
+	if ( !number(&byte) || !byte ||
+		(comma() && !number(&message)) ||
+		!bus_timeouts(a, byte, message) )
+		ERROR(TERMINAL_ERROR);
+}
+
+
+/* Reading format: FORMAT ASCII|FLOAT|INT [scale]. */
+static void format(void) {
+	double scale = 1;
+
+	switch (token(format_tokens, N_VECTOR(format_tokens))) {
+		case format_ascii:
+			reading_format(READING_ASCII, scale);
+			break;
+
+		case format_float:
+			reading_format(READING_FLOAT, scale);
+			break;
+
+		case format_int:
+			real(&scale);
+			reading_format(READING_INT, scale);
+			break;
+
+		default:
+			ERROR(TERMINAL_ERROR);
+			break;
+	}
+}
+
+
+/* Start or stop periodic acquisition: ACQUIRE [name,period[,samples]]. */
+static void acquire(void) {
+	char s[CONFIGURATION_MACRO_NAME + 1];
+	unsigned period;
+	unsigned samples = 0;
+
+	chomp();
+	if (feof(stdin)) {
+		acquire_stop();
+		return;
+	}
+
+	if ( running ||
+		!name(s) ||
+		!comma() || !number(&period) || !period ||
+		(comma() && !number(&samples)) ||
+		(configuration_macro(s) == CONFIGURATION_MACRO_NONE) ) {
+		ERROR(TERMINAL_ERROR);
+		return;
+	}
+
+	acquire_start(s, period, samples);
+}
+
+
+static void command(unsigned char t) {
+	unsigned a;
+	unsigned mask;
+
+	switch (t) {
+		case command_offline:
+			offline();
+			break;
+
+		case command_monitor:
+			monitor();
+			break;
+
+		case command_listen:
+			listen();
+			break;
+
+		case command_online:
+			gpib_control();
+			online = 1;
+			break;
+
+		case command_abort:
+			cancel();
+			gpib_passive();
+			gpib_control();
+			online = 1;
+			gpib_clear();
+			gpib_attention(1);
+			break;
+
+		case command_define:
+			define();
+			break;
+
+		case command_run:
+			run();
+			break;
+
+		case command_acquire:
+			acquire();
+			break;
+
+
+		case command_tasks:
+			runtimes();
+			break;
+
+
+		case command_srq:
+			switch (token(srq_tokens, N_VECTOR(srq_tokens))) {
+				case srq_on:
+					srq_notify(1);
+					break;
+
+				case srq_off:
+					srq_notify(0);
+					break;
+
+				case srq_enter:
+					/* Readout rule: address[,mask] */
+					mask = 0;
+					if ( !address(&a) ||
+						(comma() && !number(&mask)) ||
+						(mask > 0xFF) ||
+						!srq_readout(a, mask) )
+						ERROR(TERMINAL_ERROR);
+					break;
+
+				case srq_clear:
+					srq_readout_clear();
+					break;
+
+				default:
+					ttyio_unsigned(srq());
+					ttyio_end();
+					break;
+			}
+			break;
+
+
+		case command_timeout:
+			timeout();
+			break;
+
+		case command_time:
+			times();
+			break;
+
+		case command_status:
+			statistics();
+			break;
+
+		case command_trace:
+			traces();
+			break;
+
+		case command_memory:
+			memory();
+			break;
+
+#ifdef PROFILE
+		case command_profile:
+			profile();
+			break;
+
+		case command_handshake:
+			handshakes();
+			break;
+#endif
+
+		case command_format:
+			format();
+			break;
+
+		case command_errtrap:
+			errtrap = (token(switch_tokens, N_VECTOR(switch_tokens)) != switch_off);
+			break;
+
+		case command_reset:
+			configuration_default();
+			configuration_store();
+			break;
+
+
+		case command_langeos:
+			eos(
+				&configuration.langeos,
+				NULL,
+				NULL
+			);
+
+			configuration_store();
+			break;
+
+		case command_gpibeos:
+			eos(
+				&configuration.gpibeos,
+				&configuration.gpibeos_ineoi,
+				&configuration.gpibeos_outeoi
+			);
+
+			configuration_store();
+			break;
+
+
+		default:
+			if (!online) {
+				ERROR(TERMINAL_ERROR);
+				return;
+			}
+
+			/* Online-only commands */
+			switch (t) {
+				case command_clear:
 					gpib_clear();
 
 					/* Clear */
-					attention();
+					bus_attention();
 					if (listeners()) {
 						gpib_putchar(GPIB_SDC);
 						gpib_putchar(GPIB_UNL);
@@ -576,12 +1789,12 @@ void terminal(void) {
 
 				case command_remote:
 					gpib_remote(1);
-					attention();
+					bus_attention();
 					listeners();
 					break;
 
 				case command_local:
-					attention();
+					bus_attention();
 
 					t = token(local_tokens, N_VECTOR(local_tokens));
 					if (t == local_lockout) {
@@ -600,14 +1813,14 @@ void terminal(void) {
 
 
 				case command_trigger:
-					attention();
+					bus_attention();
 					listeners();
 					gpib_putchar(GPIB_GET);
 					break;
 
 
 				case command_output:
-					attention();
+					bus_attention();
 					listeners();
 					output();
 					break;
@@ -616,6 +1829,39 @@ void terminal(void) {
 					enter();
 					break;
 
+				case command_sweep:
+					sweep();
+					break;
+
+				case command_bench:
+					bench();
+					break;
+
+				case command_watch:
+					watching();
+					break;
+
+
+				case command_spoll:
+					spoll();
+					break;
+
+
+				case command_ppoll:
+					ppoll();
+					break;
+
+				case command_request:
+					if (address(&a))
+						request(a);
+					else
+						ERROR(TERMINAL_ERROR);
+					break;
+
+				case command_response:
+					request_response(address(&a) ? a : REQUEST_ANY);
+					break;
+
 				default:
 					/* Unknown command */
 					ERROR(TERMINAL_ERROR);
@@ -623,16 +1869,113 @@ void terminal(void) {
 			}
 			break;
 	}
+}
 
-	/* Expect EOS */
-	chomp();
-	if (!feof(stdin))
-		ERROR(TERMINAL_ERROR);
+
+/* Command lines.
+A line may carry a batch of commands separated by semicolons, e.g.
+	REMOTE 14;TRIGGER 14;ENTER 14
+The commands are executed back to back; since the bus is left addressed
+after each command, a command without addresses continues with the
+devices of its predecessor. OUTPUT takes the remainder of the line as
+data unless its length is given with #count.
+
+Execution stops at the first failing command and the rest of the line is
+discarded. With ERRTRAP enabled, the position of the failing command
+within the line is reported as "ERROR n". */
+#define SEPARATOR		';'
+
+static unsigned char batch(unsigned char t) {
+	unsigned char index = 0;
+	for (;;) {
+		index++;
+		ERROR(NO_ERROR);
+
+		if (defining) {
+			/* Record the remainder of the DEFINE line */
+			record(t);
+			break;
+		}
+
+		if (t)
+			command(t);
+
+		/* Expect separator or EOS */
+		chomp();
+		if (feof(stdin))
+			break;
+
+		if (!expect(SEPARATOR))
+			/* Garbage */
+			ERROR(TERMINAL_ERROR);
+
+		if (VOLATILE(unsigned, red_pattern) != NO_ERROR)
+			break;
+
+		t = token(command_tokens, N_VECTOR(command_tokens));
+	}
+
+	return index;
+}
+
+
+void terminal(void) {
+	/* Errors raised since the last line do not count against this one */
+	ERROR(NO_ERROR);
+	clearerr(stdin);
+
+	unsigned char t = token(command_tokens, N_VECTOR(command_tokens));
+	if (defining) {
+		record(t);
+		if (VOLATILE(unsigned, red_pattern) != NO_ERROR)
+			/* Discard remainder */
+			while (getchar() != EOF);
+
+		return;
+	}
+
+	/* Take the bus from background reception */
+	request_suspend();
+
+	unsigned char index = batch(t);
+	if (VOLATILE(unsigned, red_pattern) != NO_ERROR) {
+		/* Discard remainder */
+		while (getchar() != EOF);
+
+		if (defining) {
+			/* The DEFINE line failed, do not record what follows */
+			configuration_macro_abort();
+			defining = 0;
+		}
+
+		if (errtrap) {
+			fputs_P(PSTR("ERROR "), stdout);
+			ttyio_unsigned(index);
+			ttyio_end();
+		}
+	}
+}
+
+
+
+void terminal_macro(unsigned first) {
+	/* Take the bus from background reception */
+	request_suspend();
+
+	replay(first);
+	if ( (VOLATILE(unsigned, red_pattern) != NO_ERROR) && errtrap ) {
+		fputs_P(PSTR("ERROR"), stdout);
+		ttyio_end();
+	}
 }
 
 
 
 void terminal_prepare(void) {
 	online = 0;
+	errtrap = 0;
+	defining = 0;
+	running = 0;
+	stamping = 0;
 	STATUS(OFFLINE_STATUS);
 }
@@ -23,5 +23,6 @@ along with this program. If not, see
 
 void terminal_prepare(void);
 void terminal(void);
+void terminal_macro(unsigned first);
 
 #endif
@@ -0,0 +1,62 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "timebase.h"
+
+
+/* Timebase.
+Timer 1 runs free at 1us. Its overflows are counted in software to
+extend it to 32 bits, which wraps after about 71 minutes. The time may
+be taken from interrupts as well. An overflow that is still pending while
+the time is read is accounted for by the state of the counter: if it has
+wrapped just now, it is small. */
+
+static volatile unsigned high;
+
+
+void timebase_overflow(void) {
+	high++;
+}
+
+/* With interrupts disabled, as in interrupt handlers */
+unsigned long timebase_interrupt(void) {
+	unsigned h;
+	unsigned l;
+
+	l = TCNT1;
+	h = high;
+	if ( (TIFR & _BV(TOV1)) && (l < 0x8000) )
+		h++;
+
+	return ((unsigned long) h << 16) | l;
+}
+
+unsigned long timebase(void) {
+	unsigned char sreg = SREG;
+	unsigned long t;
+
+	cli();
+	t = timebase_interrupt();
+	SREG = sreg;
+
+	return t;
+}
@@ -0,0 +1,97 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "timebase.h"
+#include "trace.h"
+
+
+/* Bus event trace.
+The latest bus events are kept in a circular buffer for post-mortem
+analysis: commands sent under ATN, changes of the talk, control and
+attention state, EOI in either direction, timeouts and overflows. Data
+bytes are not traced, so the trace costs nothing per byte transferred.
+Along with the event, a single data byte is kept: the command, the new
+state, or the receive or transmit buffer occupancy for the others. The
+buffer is overwritten oldest first. */
+
+static struct trace_t entries[TRACE_ENTRIES];
+static unsigned char next;
+
+static const char PROGMEM names[][5] = {
+	"-",
+	"CMD",
+	"TALK",
+	"CTRL",
+	"ATN",
+	"EOI>",
+	"EOI<",
+	"TMO",
+	"OVF",
+};
+
+
+/* May be called from interrupts */
+void trace(unsigned char event, unsigned char data) {
+	unsigned char sreg = SREG;
+	cli();
+
+	struct trace_t *t = &entries[next];
+	if (++next >= TRACE_ENTRIES)
+		next = 0;
+
+	/* Interrupts are disabled here in any case */
+	t->time = timebase_interrupt();
+	t->event = event;
+	t->data = data;
+
+	SREG = sreg;
+}
+
+
+/* Oldest first */
+unsigned char trace_read(unsigned char i, struct trace_t *t) {
+	if (i >= TRACE_ENTRIES)
+		return 0;
+
+	cli();
+	i += next;
+	if (i >= TRACE_ENTRIES)
+		i -= TRACE_ENTRIES;
+
+	*t = entries[i];
+	sei();
+	return 1;
+}
+
+PGM_P trace_name(unsigned char event) {
+	return names[event];
+}
+
+void trace_reset(void) {
+	unsigned char i;
+
+	cli();
+	for (i = 0; i < TRACE_ENTRIES; i++)
+		entries[i].event = trace_none;
+	sei();
+}
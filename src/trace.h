@@ -0,0 +1,52 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <avr/pgmspace.h>
+
+/* Number of events kept */
+#define TRACE_ENTRIES			12
+
+enum trace_event_e {
+	trace_none = 0,
+	trace_command,
+	trace_talk,
+	trace_control,
+	trace_atn,
+	trace_eoi_out,
+	trace_eoi_in,
+	trace_timeout,
+	trace_overflow,
+};
+
+struct trace_t {
+	unsigned long time;
+	unsigned char event;
+	unsigned char data;
+};
+
+void trace(unsigned char event, unsigned char data);
+
+unsigned char trace_read(unsigned char i, struct trace_t *t);
+PGM_P trace_name(unsigned char event);
+void trace_reset(void);
+
+#endif
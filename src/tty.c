@@ -22,6 +22,9 @@ along with this program. If not, see
 
 #include "io.h"
 #include "main.h"
+#include "scheduler.h"
+#include "counters.h"
+#include "profile.h"
 #include "tty.h"
 
 /* TODO implement CTS handshake */
@@ -85,16 +88,22 @@ static unsigned char rx_tail;
 
 
 ISR(USART_UDRE_vect) {
+	PROFILE_ENTER();
+
 	if (tx_tail != tx_head) {
 		/* More data to transmit */
 		UDR = tx_buffer[tx_tail];
 		if (++tx_tail >= TTY_BUFFER_LENGTH)
 			tx_tail = 0;
+
+		COUNT(tty_out);
 	}
 	else {
 		/* Shutdown transmitter */
 		UCSRB &= ~_BV(UDRIE);
 	}
+
+	PROFILE_LEAVE(profile_udre);
 }
 
 void tty_putchar(char c) {
@@ -108,11 +117,14 @@ void tty_putchar(char c) {
 	/* Ensure at least room for one character is left again.
 	This condition holds as long as the (writing) head is about to
 	overtake the (reading) tail. */
-	while (head == VOLATILE(unsigned char, tx_tail));
+	while (head == VOLATILE(unsigned char, tx_tail))
+		scheduler_yield();
 
 	/* Request transmission */
 	VOLATILE(unsigned char, tx_head) = head;
 	UCSRB |= _BV(UDRIE);
+
+	PEAK(tty_tx_peak, head, VOLATILE(unsigned char, tx_tail), TTY_BUFFER_LENGTH);
 }
 
 char tty_transmitted(void) {
@@ -121,10 +133,13 @@ char tty_transmitted(void) {
 
 
 ISR(USART_RXC_vect) {
+	PROFILE_ENTER();
+
 	volatile unsigned char status = UCSRA;
 	if ( status & (_BV(FE) | _BV(DOR) | _BV(PE)) ) {
 		/* Transmission error */
 		ERROR(TTY_TRANSMISSION_ERROR);
+		COUNT(tty_errors);
 	}
 	else {
 		unsigned char head = rx_head + 1;
@@ -135,22 +150,30 @@ ISR(USART_RXC_vect) {
 			/* Buffer overflow */
 			UCSRB &= ~_BV(RXCIE);
 			ERROR(TTY_OVERFLOW_ERROR);
+			COUNT(tty_overflows);
 		}
 		else {
 			rx_buffer[rx_head] = UDR;
 			rx_head = head;
 
+			COUNT(tty_in);
+			PEAK(tty_rx_peak, head, rx_tail, TTY_BUFFER_LENGTH);
+
 			/* Signal congestion */
 			if (CTS) {
 				unsigned char remaining = rx_tail - head + TTY_BUFFER_LENGTH;
 				if (remaining > TTY_BUFFER_LENGTH)
 					remaining -= TTY_BUFFER_LENGTH;
 
-				if (remaining < TTY_BUFFER_THRESHOLD)
+				if (remaining < TTY_BUFFER_THRESHOLD) {
 					CTS = 0;
+					COUNT(tty_throttles);
+				}
 			}
 		}
 	}
+
+	PROFILE_LEAVE(profile_rxc);
 }
 
 char tty_received(void) {
@@ -158,7 +181,8 @@ char tty_received(void) {
 }
 
 char tty_getchar(void) {
-	while (!tty_received());
+	while (!tty_received())
+		scheduler_yield();
 
 	unsigned char tail = rx_tail;
 	char c = rx_buffer[tail];
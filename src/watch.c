@@ -0,0 +1,214 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "io.h"
+#include "gpib.h"
+#include "streams.h"
+#include "bus.h"
+#include "request.h"
+#include "reading.h"
+#include "scheduler.h"
+#include "main.h"
+#include "watch.h"
+
+
+/* Change detection.
+While watching, the devices in the list are read in turn once per
+period, counted in 1ms ticks of timer 1. A reading is only forwarded to
+the host if it differs from the last forwarded one by more than the
+deadband, or if it has moved into or out of the range between the low
+and the high limit. The first reading of each device is always
+forwarded. Readings are tagged with the primary address, e.g.
+"14:+2.500000E+01", followed by ",LOW" or ",HIGH" while out of range.
+
+A device failing to deliver a reading is reported once as "14:ERROR".
+It is then retried after 1, 2, 4, ... up to WATCH_BACKOFF periods, so a
+switched off device does not hold the bus in every period. Its first
+good reading is forwarded again. WATCH ON retries all devices at once.
+*/
+
+enum zone_e {
+	zone_unknown = 0,
+	zone_low,
+	zone_within,
+	zone_high,
+	zone_failed,
+};
+
+struct watch_t {
+	unsigned address;
+	unsigned char zone;
+	unsigned char backoff;
+	unsigned char wait;
+	double last;
+	double deadband;
+	double low;
+	double high;
+};
+
+static struct watch_t devices[WATCH_DEVICES];
+static unsigned char ndevices;
+
+static volatile unsigned char due;
+static volatile unsigned elapsed;
+static unsigned period;
+
+
+void watch_timer(void) {
+	if ( period && (++elapsed >= period) ) {
+		elapsed = 0;
+		due = 1;
+	}
+}
+
+
+unsigned char watch_device(unsigned address, double deadband, double low, double high) {
+	unsigned char i;
+	for (i = 0; i < ndevices; i++) {
+		if (devices[i].address == address)
+			break;
+	}
+
+	if (i >= WATCH_DEVICES)
+		return 0;
+
+	if (i == ndevices)
+		ndevices++;
+
+	devices[i].address = address;
+	devices[i].zone = zone_unknown;
+	devices[i].wait = 0;
+	devices[i].deadband = deadband;
+	devices[i].low = low;
+	devices[i].high = high;
+	return 1;
+}
+
+void watch_forget(void) {
+	ndevices = 0;
+}
+
+void watch_start(unsigned ms) {
+	unsigned char i;
+	for (i = 0; i < ndevices; i++) {
+		devices[i].zone = zone_unknown;
+		devices[i].wait = 0;
+	}
+
+	cli();
+	period = ms;
+	elapsed = 0;
+	due = 1;
+	sei();
+}
+
+void watch_stop(void) {
+	cli();
+	period = 0;
+	due = 0;
+	sei();
+}
+
+
+static void check(struct watch_t *device) {
+	unsigned char zone;
+	char s[15];
+	double x;
+
+	if (device->wait) {
+		device->wait--;
+		return;
+	}
+
+	bus_talker(device->address);
+	clearerr(gpib);
+	gpib_receive();
+	gpib_attention(0);
+	if (!reading(gpib, &x)) {
+		if (device->zone != zone_failed) {
+			device->zone = zone_failed;
+			device->backoff = 1;
+
+			ERROR(TERMINAL_ERROR);
+			ttyio_unsigned(ADDRESS_PRIMARY(device->address));
+			fputs_P(PSTR(":ERROR"), stdout);
+			ttyio_end();
+		}
+		else if (device->backoff < WATCH_BACKOFF) {
+			device->backoff <<= 1;
+		}
+
+		device->wait = device->backoff - 1;
+		return;
+	}
+
+	if (device->zone == zone_failed)
+		/* Back again, forward the first reading */
+		device->zone = zone_unknown;
+
+	if (x < device->low)
+		zone = zone_low;
+	else if (x > device->high)
+		zone = zone_high;
+	else
+		zone = zone_within;
+
+	if ( (zone == device->zone) && (fabs(x - device->last) <= device->deadband) )
+		return;
+
+	device->zone = zone;
+	device->last = x;
+
+	ttyio_unsigned(ADDRESS_PRIMARY(device->address));
+	putchar(':');
+	fputs(dtostre(x, s, 6, DTOSTR_PLUS_SIGN | DTOSTR_UPPERCASE), stdout);
+	if (zone == zone_low)
+		fputs_P(PSTR(",LOW"), stdout);
+	else if (zone == zone_high)
+		fputs_P(PSTR(",HIGH"), stdout);
+	ttyio_end();
+}
+
+void watch_task(void) {
+	unsigned char i;
+
+	if ( !due || scheduler_wanted() )
+		return;
+
+	due = 0;
+
+	/* Take the bus from background reception */
+	request_suspend();
+
+	for (i = 0; i < ndevices; i++)
+		check(&devices[i]);
+}
+
+
+void watch_prepare(void) {
+	ndevices = 0;
+	watch_stop();
+}
@@ -0,0 +1,40 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Number of watched devices */
+#define WATCH_DEVICES			4
+
+/* Longest retry interval of a failing device, in periods */
+#define WATCH_BACKOFF			64
+
+
+void watch_timer(void);
+
+unsigned char watch_device(unsigned address, double deadband, double low, double high);
+void watch_forget(void);
+void watch_start(unsigned period);
+void watch_stop(void);
+
+void watch_task(void);
+void watch_prepare(void);
+
+#endif
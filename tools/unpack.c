@@ -0,0 +1,62 @@
+
+/* GPIB to RS232 converter.
+Copyright (C) 2012  Sven Pauli <sven_pauli@gmx.de>
+
+This program is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see
+	<http://www.gnu.org/licenses/>. */
+
+
+/* Decoder for ENTER PACK transfers.
+Reads the PackBits stream as sent by the converter from stdin and writes
+the original message to stdout. Stops at the end marker, so it can be
+run on the serial port directly, e.g.
+
+	make -C tools
+	tools/unpack < /dev/ttyS0 > dump.hpgl
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(void) {
+	int n;
+	int ch;
+
+	while ( (n = getchar()) != EOF ) {
+		if (n == 128)
+			return EXIT_SUCCESS;
+
+		if (n < 128) {
+			/* Literals */
+			for (n++; n > 0; n--) {
+				if ( (ch = getchar()) == EOF )
+					goto truncated;
+
+				putchar(ch);
+			}
+		}
+		else {
+			/* Run */
+			if ( (ch = getchar()) == EOF )
+				goto truncated;
+
+			for (n = 257 - n; n > 0; n--)
+				putchar(ch);
+		}
+	}
+
+truncated:
+	fprintf(stderr, "unpack: truncated stream\n");
+	return EXIT_FAILURE;
+}